@@ -80,6 +80,12 @@ void ConfigManagerPrivate::update()
     set.beginGroup(SEMANTIC_ANALYSIS_GROUP);
     setValue(SEMANTIC_ANALYSIS_GROUP, ENABLE_SEMANTIC_ANALYSIS, set.value(ENABLE_SEMANTIC_ANALYSIS, false));
     set.endGroup();
+
+    set.beginGroup(VECTOR_INDEX_GROUP);
+    for (const QString &key : set.childKeys()) {
+        setValue(VECTOR_INDEX_GROUP, key, set.value(key));
+    }
+    set.endGroup();
 }
 
 ConfigManager::ConfigManager(QObject *parent)
@@ -20,6 +20,15 @@
 #define SEMANTIC_ANALYSIS_GROUP "SemanticAnalysis"
 #define ENABLE_SEMANTIC_ANALYSIS "EnableSemanticAnalysis"
 
+#define VECTOR_INDEX_GROUP "VectorIndex"
+#define VECTOR_INDEX_NPROBE "NProbe"
+#define VECTOR_INDEX_COMPACT_SEGMENTS "CompactSegments"
+#define VECTOR_INDEX_VECTOR_CACHE_SIZE "VectorCacheSize"   // <= 0 不限制
+// 以下三项可用"<appID>.<键名>"按应用单独配置
+#define VECTOR_INDEX_MAX_CHUNKS "MaxChunks"
+#define VECTOR_INDEX_CHUNK_SAMPLING "ChunkSampling"
+#define VECTOR_INDEX_DEFER_REMAINING "DeferRemaining"
+
 #define ConfigManagerIns ConfigManager::instance()
 
 class ConfigManagerPrivate;
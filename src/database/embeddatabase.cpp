@@ -7,25 +7,111 @@
 #include <QTimer>
 #include <QDebug>
 
+static constexpr int kBusyTimeout = 5000;               // ms
+static constexpr int kCacheSize = -16 * 1024;           // 负数单位为KB，即16MB
+static constexpr qint64 kMmapSize = 256 * 1024 * 1024;  // 256MB
+static constexpr int kMaxPreparedQueries = 64;          // 每个连接缓存的预编译语句数
+
+constexpr int EmbedDBVendor::kMaxBindValues;
+
 EmbedDBVendor *EmbedDBVendor::instance()
 {
     static EmbedDBVendor ins;
     return &ins;
 }
 
-QSqlDatabase EmbedDBVendor::addDatabase(const QString &databasePath)
+QSqlDatabase EmbedDBVendor::addDatabase(const QString &databasePath, bool readOnly)
 {
     //打开数据库
     //QString databasePath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + QDir::separator() +  databaseName;
     auto db = QSqlDatabase::addDatabase("QSQLITE", QUuid::createUuid().toString());
     db.setDatabaseName(databasePath);
+    QString options = QString("QSQLITE_BUSY_TIMEOUT=%0").arg(kBusyTimeout);
+    if (readOnly)
+        options += ";QSQLITE_OPEN_READONLY";
+    db.setConnectOptions(options);
     return db;
 }
 
+// 本线程创建的只读连接：主连接名 -> 只读连接名。连接只在创建它的线程上使用，线程退出时在该线程上关闭
+struct EmbedDBVendor::ThreadReaders
+{
+    QHash<QString, QString> names;
+
+    ~ThreadReaders()
+    {
+        for (const QString &name : names)
+            EmbedDBVendorIns->releaseReader(name);
+    }
+};
+
+QSqlDatabase EmbedDBVendor::readerDatabase(QSqlDatabase *db)
+{
+    // 每个线程独立的只读连接，WAL模式下读与写连接可以并发
+    if (!threadReaders.hasLocalData())
+        threadReaders.setLocalData(new ThreadReaders);
+
+    ThreadReaders *local = threadReaders.localData();
+    releaseStaleReaders(local);
+
+    const QString connectionName = db->connectionName();
+    auto it = local->names.constFind(connectionName);
+    if (it != local->names.constEnd())
+        return QSqlDatabase::database(it.value(), false);
+
+    // 线程id会被复用，连接名不能以线程id区分
+    const QString name = QString("%0-reader-%1").arg(connectionName).arg(QUuid::createUuid().toString());
+    QSqlDatabase reader = QSqlDatabase::cloneDatabase(*db, name);
+    reader.setConnectOptions(QString("QSQLITE_BUSY_TIMEOUT=%0;QSQLITE_OPEN_READONLY").arg(kBusyTimeout));
+    local->names.insert(connectionName, name);
+    return reader;
+}
+
+void EmbedDBVendor::releaseReader(const QString &name)
+{
+    {
+        QMutexLocker lk(&preparedMtx);
+        preparedQueries.remove(name);
+    }
+
+    {
+        QSqlDatabase reader = QSqlDatabase::database(name, false);
+        reader.close();
+    }
+    QSqlDatabase::removeDatabase(name);
+}
+
+void EmbedDBVendor::releaseStaleReaders(ThreadReaders *local)
+{
+    // 主连接已移除的只读连接，在所属线程上清理
+    for (auto it = local->names.begin(); it != local->names.end();) {
+        if (!QSqlDatabase::contains(it.key())) {
+            releaseReader(it.value());
+            it = local->names.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
 void EmbedDBVendor::removeDatabase(QSqlDatabase *db)
 {
-    if (db)
-        QSqlDatabase::removeDatabase(db->connectionName());
+    if (!db)
+        return;
+
+    const QString connectionName = db->connectionName();
+    {
+        QMutexLocker lk(&preparedMtx);
+        preparedQueries.remove(connectionName);
+    }
+
+    db->close();
+    *db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(connectionName);
+
+    // 其他线程的只读连接在其下次取连接或退出时移除
+    if (threadReaders.hasLocalData())
+        releaseStaleReaders(threadReaders.localData());
 }
 
 bool EmbedDBVendor::executeQuery(QSqlDatabase *db, const QString &queryStr, QList<QVariantList> &result)
@@ -50,7 +136,6 @@ bool EmbedDBVendor::executeQuery(QSqlDatabase *db, const QString &queryStr, QLis
         qDebug() << "Error executing query:" << query.lastError().text();
     }
 
-    closeDB(db);
     return ret;
 }
 
@@ -67,7 +152,37 @@ bool EmbedDBVendor::executeQuery(QSqlDatabase *db, const QString &queryStr)
     else
         qWarning() << "Error executing query:" << query.lastError().text();
 
-    closeDB(db);
+    return ret;
+}
+
+bool EmbedDBVendor::executePreparedQuery(QSqlDatabase *db, const QString &queryStr, const QVariantList &bindValues, QList<QVariantList> &result)
+{
+    bool ret = false;
+
+    if (!openDB(db))
+        return ret;
+
+    QSharedPointer<QSqlQuery> query = preparedQuery(db, queryStr);
+    if (query) {
+        for (int i = 0; i < bindValues.size(); i++)
+            query->bindValue(i, bindValues.at(i));
+
+        if (query->exec()) {
+            const int columns = query->record().count();
+            while (query->next()) {
+                QVariantList res;
+                for (int i = 0; i < columns; i++)
+                    res.append(query->value(i));
+
+                result.append(res);
+            }
+            ret = true;
+        } else {
+            qWarning() << "Error executing query:" << query->lastError().text();
+        }
+        query->finish();
+    }
+
     return ret;
 }
 
@@ -94,12 +209,49 @@ bool EmbedDBVendor::commitTransaction(QSqlDatabase *db, const QStringList &query
                 ret= false;
             }
         }
+
+        // 连接常驻，失败的事务必须回滚
+        if (!ret)
+            query.exec("ROLLBACK");
     } else {
         qWarning() << "Failed to begin transaction" << db->databaseName();
         ret = false;
     }
 
-    closeDB(db);
+    return ret;
+}
+
+bool EmbedDBVendor::executeBatch(QSqlDatabase *db, const QString &queryStr, const QList<QVariantList> &bindColumns)
+{
+    if (!openDB(db))
+        return false;
+
+    QSharedPointer<QSqlQuery> query = preparedQuery(db, queryStr);
+    if (!query)
+        return false;
+
+    if (!db->transaction()) {
+        qWarning() << "Failed to begin transaction" << db->databaseName();
+        return false;
+    }
+
+    // 同一条预编译语句绑定整列数据，在一个事务内批量执行
+    for (const QVariantList &column : bindColumns)
+        query->addBindValue(column);
+
+    bool ret = query->execBatch();
+    if (!ret)
+        qWarning() << "Error executing batch:" << query->lastError().text();
+    query->finish();
+
+    if (ret && !db->commit()) {
+        qWarning() << "Failed to commit transaction" << db->databaseName();
+        ret = false;
+    }
+
+    if (!ret)
+        db->rollback();
+
     return ret;
 }
 
@@ -119,22 +271,79 @@ bool EmbedDBVendor::isEmbedDataTableExists(QSqlDatabase *db, const QString &tabl
     else
         qWarning() << "Error executing query:" << query.lastError().text();
 
-    closeDB(db);
     return ret;
 }
 
 bool EmbedDBVendor::openDB(QSqlDatabase *db)
 {
-    if (!(db->isOpen() || db->open())) {
-        qDebug() << "Failed to open database";
+    if (db->isOpen())
+        return true;
+
+    if (!db->open()) {
+        qDebug() << "Failed to open database" << db->databaseName();
         return false;
     }
+
+    // 连接常驻到worker退出，只在首次打开时配置
+    QSqlQuery query(*db);
+    if (!isReadOnly(db)) {
+        query.exec("PRAGMA journal_mode=WAL");
+        query.exec("PRAGMA synchronous=NORMAL");
+    }
+    query.exec(QString("PRAGMA cache_size=%0").arg(kCacheSize));
+    query.exec(QString("PRAGMA mmap_size=%0").arg(kMmapSize));
     return true;
 }
 
-void EmbedDBVendor::closeDB(QSqlDatabase *db)
+bool EmbedDBVendor::isReadOnly(QSqlDatabase *db) const
 {
-    db->close();
+    return db->connectOptions().contains("QSQLITE_OPEN_READONLY");
+}
+
+QSharedPointer<QSqlQuery> EmbedDBVendor::preparedQuery(QSqlDatabase *db, const QString &queryStr)
+{
+    QMutexLocker lk(&preparedMtx);
+    QSharedPointer<QueryCache> &queries = preparedQueries[db->connectionName()];
+    if (!queries)
+        queries.reset(new QueryCache(kMaxPreparedQueries));
+
+    if (QSharedPointer<QSqlQuery> *cached = queries->object(queryStr))
+        return *cached;
+
+    QSharedPointer<QSqlQuery> query(new QSqlQuery(*db));
+    if (!query->prepare(queryStr)) {
+        qWarning() << "Error preparing query:" << query->lastError().text();
+        return {};
+    }
+
+    // 已满时只淘汰最久未用的一条
+    queries->insert(queryStr, new QSharedPointer<QSqlQuery>(query));
+    return query;
+}
+
+QString EmbedDBVendor::inPlaceholders(QVariantList &values)
+{
+    Q_ASSERT(!values.isEmpty() && values.size() <= kMaxBindValues);
+
+    static const int arities[] = { 1, 8, 32, 128, kMaxBindValues };
+    int count = kMaxBindValues;
+    for (int arity : arities) {
+        if (values.size() <= arity) {
+            count = arity;
+            break;
+        }
+    }
+
+    // 重复最后一个值补齐，IN中的重复值不影响结果
+    const QVariant last = values.last();
+    while (values.size() < count)
+        values << last;
+
+    QStringList placeholders;
+    placeholders.reserve(count);
+    for (int i = 0; i < count; i++)
+        placeholders << "?";
+    return placeholders.join(", ");
 }
 
 EmbedDBVendor::EmbedDBVendor()
@@ -9,6 +9,8 @@
 #include <QThread>
 #include <QtSql>
 #include <QMutex>
+#include <QThreadStorage>
+#include <QCache>
 
 #define EmbedDBVendorIns EmbedDBVendor::instance()
 
@@ -16,18 +18,38 @@ class EmbedDBVendor
 {
 public:
     static EmbedDBVendor *instance();
-    QSqlDatabase addDatabase(const QString &databasePath);
+    QSqlDatabase addDatabase(const QString &databasePath, bool readOnly = false);
     void removeDatabase(QSqlDatabase *db);
+    QSqlDatabase readerDatabase(QSqlDatabase *db);
     bool executeQuery(QSqlDatabase *db, const QString &queryStr, QList<QVariantList> &result);
     bool executeQuery(QSqlDatabase *db, const QString &queryStr);
+    bool executePreparedQuery(QSqlDatabase *db, const QString &queryStr, const QVariantList &bindValues, QList<QVariantList> &result);
     bool commitTransaction(QSqlDatabase *db, const QStringList &queryList);
+    bool executeBatch(QSqlDatabase *db, const QString &queryStr, const QList<QVariantList> &bindColumns);
     bool isEmbedDataTableExists(QSqlDatabase *db, const QString &tableName);
+
+    // 一条语句的IN列表最多绑定的参数个数
+    static constexpr int kMaxBindValues = 500;
+    // 参数个数补齐到固定的几档后返回占位符，限制预编译语句的种数；values不超过kMaxBindValues
+    static QString inPlaceholders(QVariantList &values);
 protected:
     bool openDB(QSqlDatabase *db);
-    void closeDB(QSqlDatabase *db);
+    bool isReadOnly(QSqlDatabase *db) const;
+    QSharedPointer<QSqlQuery> preparedQuery(QSqlDatabase *db, const QString &queryStr);
 private:
     explicit EmbedDBVendor();
 
+    struct ThreadReaders;
+    void releaseReader(const QString &name);
+    void releaseStaleReaders(ThreadReaders *local);
+
+    // connectionName -> (SQL -> prepared query)，按最近使用淘汰
+    using QueryCache = QCache<QString, QSharedPointer<QSqlQuery>>;
+    QHash<QString, QSharedPointer<QueryCache>> preparedQueries;
+    QMutex preparedMtx;
+
+    // 各线程的只读连接，随线程退出移除
+    QThreadStorage<ThreadReaders *> threadReaders;
 };
 
 #endif // EMBEDDATABASE_H
@@ -8,13 +8,21 @@
 #include "database/embeddatabase.h"
 #include "global_define.h"
 #include "index/indexmanager.h"
+#include "utils/filecrawler.h"
 
 #include <QDebug>
 #include <QDir>
 #include <QFileInfo>
+#include <QElapsedTimer>
+#include <QQueue>
+#include <QSharedPointer>
+#include <QtConcurrent/QtConcurrent>
 
-#include <dirent.h>
 #include <sys/stat.h>
+#include <stdlib.h>
+
+static constexpr int kDeferredIdleTime = 2 * 60 * 1000;   // 距上次建索引/删除请求至少2分钟才补建
+static constexpr int kMonitorCreateDelay = 1000;           // 新建事件合并等待的时间(ms)
 
 EmbeddingWorkerPrivate::EmbeddingWorkerPrivate(QObject *parent)
     : QObject(parent)
@@ -43,17 +51,22 @@ void EmbeddingWorkerPrivate::init()
     embedder = new Embedding(&dataBase, &dbMtx, appID, this);
     indexer = new VectorIndex(&dataBase, &dbMtx, appID, this);
 
-    QString databasePath;
-    if (appID == kSystemAssistantKey)
-        databasePath = QString("%0.db").arg(kSystemAssistantData);
-    else
-        databasePath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + QDir::separator() +  appID + ".db";;
-    dataBase = EmbedDBVendorIns->addDatabase(databasePath);
+    if (appID == kSystemAssistantKey) {
+        // 系统助手知识库只读，使用长连接
+        dataBase = EmbedDBVendorIns->addDatabase(QString("%0.db").arg(kSystemAssistantData), true);
+    } else {
+        QString databasePath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + QDir::separator() +  appID + ".db";
+        dataBase = EmbedDBVendorIns->addDatabase(databasePath);
+        indexer->recoverSegments();
+    }
 
     if (appID == kUosAIAssistant) {
         // uos-ai 另存原文档
         m_saveAsDoc = true;
     }
+
+    // 空闲线程按默认时间退出，其只读数据库连接随线程释放
+    parsePool.setMaxThreadCount(QThread::idealThreadCount());
 }
 
 bool EmbeddingWorkerPrivate::enableEmbedding(const QString &file)
@@ -98,85 +111,194 @@ int EmbeddingWorkerPrivate::updateIndex(const QStringList &files)
     if (files.isEmpty())
         return GET_INDEX_STATUS_CODE(INDEX_STATUS_DOCERROR);
 
+    cancelled.storeRelease(0);
+    lastActive.start();
+
+    //去重，整批文件一次查重
     bool embedRes = true;
-    for (const QString &embeddingfile : files) {
-        if (m_saveAsDoc)
-            embedRes &= embedder->embeddingDocumentSaveAs(embeddingfile);
-        else
-            embedRes &= embedder->embeddingDocument(embeddingfile);
-    }
+    QStringList docs;
+    {
+        QStringList sources;
+        QSet<QString> seen;
+        for (const QString &embeddingfile : files) {
+            QString source = embedder->documentSource(embeddingfile, m_saveAsDoc);
+            if (seen.contains(source))
+                continue;
+            seen.insert(source);
+            docs << embeddingfile;
+            sources << source;
+        }
 
-    if (!embedRes) {
-        embedder->embeddingClear();
-        return GET_INDEX_STATUS_CODE(INDEX_STATUS_DOCERROR);
+        const QSet<QString> existing = embedder->existingDocuments(sources);
+        for (int i = sources.size() - 1; i >= 0; i--) {
+            if (existing.contains(sources.at(i))) {
+                qWarning() << sources.at(i) << "doc duplicate";
+                embedRes = false;
+                docs.removeAt(i);
+            }
+        }
     }
 
-    bool updateRes = indexer->updateIndex(EmbeddingDim, embedder->getEmbedVectorCache());
-    if (!updateRes) {
-        embedder->embeddingClear();
-        return GET_INDEX_STATUS_CODE(INDEX_STATUS_DATAERROR);
-    }
+    // 流水线：线程池并行解析、分块并提交向量化请求(客户端限制在途批次)，
+    // 本线程按提交顺序取回向量并写入缓存与索引。队列有界，解析快于向量化时自然等待
+    struct Job {
+        QString file;
+        QFuture<bool> submitted;
+        QSharedPointer<Embedding::PendingDocument> doc;
+    };
+    QQueue<Job> queue;
+    const int maxQueued = qMax(2, parsePool.maxThreadCount() * 2);
+    const int total = docs.size();
+    int next = 0;
+    int finished = 0;
+    int unindexed = 0;
+    bool indexRes = true;
+    QElapsedTimer progressTimer;
+    progressTimer.start();
+
+    while (next < total || !queue.isEmpty()) {
+        while (!cancelled.loadAcquire() && next < total && queue.size() < maxQueued) {
+            Job job;
+            job.doc.reset(new Embedding::PendingDocument);
+            const QString file = docs.at(next++);
+            job.file = file;
+            const bool saveAs = m_saveAsDoc;
+            Embedding *e = embedder;
+            QSharedPointer<Embedding::PendingDocument> doc = job.doc;
+            job.submitted = QtConcurrent::run(&parsePool, [e, file, saveAs, doc]() {
+                return e->submitDocument(file, saveAs, *doc, false);
+            });
+            queue.enqueue(job);
+        }
+
+        if (queue.isEmpty())
+            break;
+
+        Job job = queue.dequeue();
+        bool ok = job.submitted.result();
+        if (cancelled.loadAcquire())
+            continue;
+
+        if (ok)
+            ok = embedder->finishDocument(*job.doc);
+        embedRes &= ok;
+        finished++;
 
-    if (m_saveAsDoc) {
         // 复制原文档
-        for (const QString &embeddingfile : files) {
-            embedder->doSaveAsDoc(embeddingfile);
+        if (ok && m_saveAsDoc)
+            embedder->doSaveAsDoc(job.file);
+
+        // 分段追加到缓存索引，避免整批文档全部留在内存中
+        if (ok)
+            unindexed += job.doc->chunks.size();
+        if (unindexed >= kIndexAppendChunks) {
+            indexRes &= indexer->updateIndex(EmbeddingDim, embedder->getVectorStore());
+            unindexed = 0;
+        }
+
+        if (finished == total || progressTimer.elapsed() >= 500) {
+            Q_EMIT progressChanged(finished, total);
+            progressTimer.restart();
         }
     }
 
+    if (cancelled.loadAcquire()) {
+        qInfo() << appID << "index creating canceled" << finished << "/" << total;
+        if (unindexed > 0)
+            indexer->updateIndex(EmbeddingDim, embedder->getVectorStore());
+        return GET_INDEX_STATUS_CODE(INDEX_STATUS_CANCELED);
+    }
+
+    if (unindexed > 0)
+        indexRes &= indexer->updateIndex(EmbeddingDim, embedder->getVectorStore());
+    lastActive.start();
+
+    if (!indexRes)
+        return GET_INDEX_STATUS_CODE(INDEX_STATUS_DATAERROR);
+
     indexUpdateTime = QDateTime::currentDateTimeUtc().toSecsSinceEpoch();
+
+    // 失败的文档跳过，已成功的保留
+    if (!embedRes)
+        return GET_INDEX_STATUS_CODE(INDEX_STATUS_DOCERROR);
+
     return GET_INDEX_STATUS_CODE(INDEX_STATUS_SUCCESS);
 }
 
+bool EmbeddingWorkerPrivate::isIdle()
+{
+    //正在建索引、最近有请求或系统负载较高时不算空闲
+    if (m_creatingAll || (lastActive.isValid() && lastActive.elapsed() < kDeferredIdleTime))
+        return false;
+
+    double load = 0;
+    if (getloadavg(&load, 1) == 1 && load > QThread::idealThreadCount() * 0.5)
+        return false;
+
+    return true;
+}
+
 bool EmbeddingWorkerPrivate::deleteIndex(const QStringList &files)
 {
-    QString sourceStr = "(";
-    for (const QString &source : files) {
-        if (files.last() == source) {
-            sourceStr += "'" + source + "')";
-            break;
+    lastActive.start();
+    embedder->deleteDeferredChunks(files);
+
+    //删除缓存中的数据，并从缓存索引中移除对应id
+    const QVector<faiss::idx_t> cacheIds = embedder->deleteCacheIndex(files);
+    indexer->removeCacheIds(cacheIds);
+
+    //已落盘但元数据尚未写入的文本块，同样需要在所在段中标记删除
+    QVariantList ids;
+    for (faiss::idx_t id : cacheIds)
+        ids << static_cast<qlonglong>(id);
+
+    //删除已存储的数据，路径按参数绑定，每批不超过SQLite的参数上限
+    for (int pos = 0; pos < files.size(); pos += EmbedDBVendor::kMaxBindValues) {
+        QVariantList sources;
+        for (const QString &file : files.mid(pos, EmbedDBVendor::kMaxBindValues))
+            sources << file;
+
+        const QString in = EmbedDBVendor::inPlaceholders(sources);
+        QString queryDeleteID = "SELECT id FROM " + QString(kEmbeddingDBMetaDataTable) + " WHERE source IN (" + in + ")";
+        QString queryDelete = "DELETE FROM " + QString(kEmbeddingDBMetaDataTable) + " WHERE source IN (" + in + ")";
+        QList<QVariantList> result;
+        QList<QVariantList> unused;
+        {
+            QMutexLocker lk(&dbMtx);
+            EmbedDBVendorIns->executePreparedQuery(&dataBase, queryDeleteID, sources, result);
+            EmbedDBVendorIns->executePreparedQuery(&dataBase, queryDelete, sources, unused);
         }
-        sourceStr += "'" + source + "', ";
-    }
 
-    //删除缓存中的数据、重置缓存索引
-    if (!embedder->getEmbedVectorCache().isEmpty()) {
-        embedder->deleteCacheIndex(files);
-        indexer->resetCacheIndex(EmbeddingDim, embedder->getEmbedVectorCache());
+        for (const QVariantList &res : result) {
+            if (!res.isEmpty() && res[0].isValid())
+                ids << res[0].toLongLong();
+        }
     }
 
-    //删除已存储的数据
-    QList<QVariantList> result;
-    QString queryDeleteID = "SELECT id FROM " + QString(kEmbeddingDBMetaDataTable) + " WHERE source IN " + sourceStr;
-    QString queryDelete = "DELETE FROM " + QString(kEmbeddingDBMetaDataTable) + " WHERE source IN " + sourceStr;
-    {
-        QMutexLocker lk(&dbMtx);
-        EmbedDBVendorIns->executeQuery(&dataBase, queryDeleteID, result);        
-        EmbedDBVendorIns->executeQuery(&dataBase, queryDelete);
+    // 索引deleteBitSet置1。查询所在段到写入删除集合持同一把锁，不会与段合并的切换交错
+    QMutexLocker segLk(&dbMtx);
+    QList<QVariantList> segResult;
+    for (int pos = 0; pos < ids.size(); pos += EmbedDBVendor::kMaxBindValues) {
+        QVariantList values = ids.mid(pos, EmbedDBVendor::kMaxBindValues);
+        const QString in = EmbedDBVendor::inPlaceholders(values);
+        QString updateBitSet = "UPDATE " + QString(kEmbeddingDBIndexSegTable) + " SET " + QString(kEmbeddingDBSegIndexTableBitSet)
+                               + " = 1 WHERE id IN (" + in + ")";
+        QString querySegment = "SELECT id, " + QString(kEmbeddingDBSegIndexIndexName) + " FROM "
+                               + QString(kEmbeddingDBIndexSegTable) + " WHERE id IN (" + in + ")";
+        QList<QVariantList> unused;
+        EmbedDBVendorIns->executePreparedQuery(&dataBase, updateBitSet, values, unused);
+        EmbedDBVendorIns->executePreparedQuery(&dataBase, querySegment, values, segResult);
     }
 
-    // 索引deleteBitSet置1
-    QString idsStr = "(";
-    for (const QVariantList &res : result) {
-        if (res.empty())
-            break;
-
-        if (!res[0].isValid())
+    // 同步更新各索引段的删除集合，检索时不再查表
+    QHash<QString, QVector<faiss::idx_t>> segmentDeleted;
+    for (const QVariantList &res : segResult) {
+        if (res.size() < 2 || !res[0].isValid())
             continue;
-
-        faiss::idx_t id = res[0].toInt();
-        if (result.last() == res) {
-            idsStr += "'" + QString::number(id) + "')";
-            break;
-        }
-        idsStr += "'" + QString::number(id) + "', ";
-    }
-    QString updateBitSet = "UPDATE " + QString(kEmbeddingDBIndexSegTable) + " SET " + QString(kEmbeddingDBSegIndexTableBitSet)
-                           + " = '" + QString::number(1) + "' WHERE id IN " + idsStr;
-    {
-        QMutexLocker lk(&dbMtx);
-        EmbedDBVendorIns->executeQuery(&dataBase, updateBitSet);
+        segmentDeleted[res[1].toString()] << res[0].toLongLong();
     }
+    indexer->markDumpDeleted(segmentDeleted);
+    segLk.unlock();
 
     // 删除另存的文档
     if (m_saveAsDoc)
@@ -185,18 +307,55 @@ bool EmbeddingWorkerPrivate::deleteIndex(const QStringList &files)
     return true;
 }
 
-QString EmbeddingWorkerPrivate::vectorSearch(const QString &query, int topK)
+QString EmbeddingWorkerPrivate::vectorSearch(const QString &query, int topK, int snippetLength)
 {
+    QElapsedTimer timer;
+    timer.start();
+
     QVector<float> queryVector;  //查询向量 传递float指针
     embedder->embeddingQuery(query, queryVector);
+    const double embedTime = timer.nsecsElapsed() / 1e6;
+    if (queryVector.size() != EmbeddingDim) {
+        qWarning() << "embedding query failed:" << query;
+        return {};
+    }
 
-    QMap<float, faiss::idx_t> cacheSearchRes;
-    QMap<float, faiss::idx_t> dumpSearchRes;
-    indexer->vectorSearch(topK, queryVector.data(), cacheSearchRes, dumpSearchRes);
-    QString res = embedder->loadTextsFromSearch(topK, cacheSearchRes, dumpSearchRes);
+    timer.restart();
+    VectorSearchResult searchResult = indexer->vectorSearch(topK, queryVector.data());
+    const double searchTime = timer.nsecsElapsed() / 1e6;
+
+    double fetchTime = 0;
+    double buildTime = 0;
+    QString res = embedder->loadTextsFromSearch(topK, searchResult, snippetLength, &fetchTime, &buildTime);
+
+    // 记录各阶段耗时(ms)
+    QJsonObject timing;
+    timing["embedQuery"] = embedTime;
+    timing["annSearch"] = searchTime;
+    timing["metadataFetch"] = fetchTime;
+    timing["jsonBuild"] = buildTime;
+    timing["total"] = embedTime + searchTime + fetchTime + buildTime;
+    timing["hits"] = searchResult.size();
+    qInfo() << appID << "search timing:" << timing;
+    {
+        QMutexLocker lk(&diagnosticsMtx);
+        lastSearchTiming = timing;
+    }
     return res;
 }
 
+QString EmbeddingWorkerPrivate::diagnostics()
+{
+    QJsonObject obj;
+    obj["appID"] = appID;
+    {
+        QMutexLocker lk(&diagnosticsMtx);
+        obj["search"] = lastSearchTiming;
+    }
+    obj["embedding"] = embedder->diagnostics();
+    return QJsonDocument(obj).toJson(QJsonDocument::Compact);
+}
+
 QString EmbeddingWorkerPrivate::indexDir()
 {
     return workerDir() + QDir::separator() + appID;
@@ -225,9 +384,9 @@ QString EmbeddingWorkerPrivate::getIndexDocs()
     QStringList dumpDocs;
     QList<QVariantList> result;
     {
-        QMutexLocker lk(&dbMtx);
         QString queryDocs = "SELECT source, content FROM " + QString(kEmbeddingDBMetaDataTable);
-        EmbedDBVendorIns->executeQuery(&dataBase, queryDocs, result);
+        QSqlDatabase reader = EmbedDBVendorIns->readerDatabase(&dataBase);
+        EmbedDBVendorIns->executeQuery(&reader, queryDocs, result);
     }
     QStringList queryResult;
     for (const QVariantList &res : result) {
@@ -280,6 +439,21 @@ bool EmbeddingWorkerPrivate::isFilter(const QString &file)
         });
 }
 
+QStringList EmbeddingWorkerPrivate::newDocuments(const QStringList &files)
+{
+    QStringList sources;
+    for (const QString &file : files)
+        sources << embedder->documentSource(file, m_saveAsDoc);
+
+    const QSet<QString> existing = embedder->existingDocuments(sources);
+    QStringList docs;
+    for (int i = 0; i < files.size(); i++) {
+        if (!existing.contains(sources.at(i)))
+            docs << files.at(i);
+    }
+    return docs;
+}
+
 EmbeddingWorker::EmbeddingWorker(const QString &appid, QObject *parent)
     : QObject(parent),
       d(new EmbeddingWorkerPrivate(this))
@@ -289,10 +463,19 @@ EmbeddingWorker::EmbeddingWorker(const QString &appid, QObject *parent)
     d->appID = appid;
     d->init();
 
+    // 随d移到工作线程
+    d->createTimer = new QTimer(d);
+    d->createTimer->setInterval(kMonitorCreateDelay);
+    d->createTimer->setSingleShot(true);
+    connect(d->createTimer, &QTimer::timeout, this, &EmbeddingWorker::doPendingCreate);
+
     moveToThread(&d->workThread);
     d->workThread.start();
 
     connect(this, &EmbeddingWorker::stopEmbedding, this, &EmbeddingWorker::doIndexDump);
+    connect(d, &EmbeddingWorkerPrivate::progressChanged, this, [this](int finished, int total) {
+        Q_EMIT indexProgress(d->appID, finished, total);
+    });
     connect(d->indexer, &VectorIndex::indexDump, this, &EmbeddingWorker::doIndexDump);
 
     dumpTimer.setInterval(30000); // 30秒落一次盘
@@ -300,6 +483,14 @@ EmbeddingWorker::EmbeddingWorker(const QString &appid, QObject *parent)
     connect(&dumpTimer, &QTimer::timeout, this, &EmbeddingWorker::doIndexDump);
     dumpTimer.start(10000);
 
+    // 系统助手知识库只读，不补建
+    if (d->appID != kSystemAssistantKey) {
+        deferTimer.setInterval(10000);
+        deferTimer.setSingleShot(false);
+        connect(&deferTimer, &QTimer::timeout, this, &EmbeddingWorker::doDeferredIndex);
+        deferTimer.start();
+    }
+
     //索引建立成功，完成后续操作
     //connect(this, &EmbeddingWorker::indexCreateSuccess, d->embedder, &Embedding::onIndexCreateSuccess);
 }
@@ -324,14 +515,15 @@ EmbeddingWorker::~EmbeddingWorker()
     //TODO:停止embeddding、已建索引落盘、数据存储等
 }
 
-void EmbeddingWorker::setEmbeddingApi(embeddingApi api, void *user)
+void EmbeddingWorker::setEmbeddingClient(EmbeddingClient *client)
 {
-    d->embedder->setEmbeddingApi(api, user);
+    d->embedder->setEmbeddingClient(client);
 }
 
 void EmbeddingWorker::stop()
 {
     d->m_creatingAll = false;
+    d->cancelled.storeRelease(1);
     Q_EMIT stopEmbedding();
 }
 
@@ -398,95 +590,129 @@ bool EmbeddingWorker::doDeleteIndex(const QStringList &files)
 
 void EmbeddingWorker::onFileMonitorCreate(const QString &file)
 {
-    doCreateIndex(QStringList(file));
+    if (!d->isSupportDoc(file))
+        return;
+
+    //短时间内的新建事件攒成一批
+    d->pendingCreates << file;
+    if (d->pendingCreates.size() >= d->createBatchSize())
+        doPendingCreate();
+    else if (!d->createTimer->isActive())
+        d->createTimer->start();
 }
 
 void EmbeddingWorker::onFileMonitorDelete(const QString &file)
 {
+    d->pendingCreates.removeAll(file);
     doDeleteIndex(QStringList(file));
 }
 
+void EmbeddingWorker::doPendingCreate()
+{
+    d->createTimer->stop();
+    if (d->pendingCreates.isEmpty())
+        return;
+
+    QStringList files;
+    files.swap(d->pendingCreates);
+    doCreateIndex(files);
+}
+
 void EmbeddingWorker::doIndexDump()
 {
-    faiss::idx_t startID = d->indexer->getDumpIndexIDRange().first;
-    faiss::idx_t endID = d->indexer->getDumpIndexIDRange().second;
+    // 先写段文件与index_segment表，再写元数据，两者都成功后才清理缓存；失败的一步在下次落盘时重试
+    const QPair<faiss::idx_t, faiss::idx_t> range = d->indexer->getDumpIndexIDRange();
+    if (range.first <= range.second && !d->indexer->doIndexDump())
+        return;
+
+    const faiss::idx_t dumpedID = d->indexer->getDumpedIndexID();
+    if (dumpedID >= 0)
+        d->embedder->doIndexDump(dumpedID);
+}
 
-    if (startID > endID)
+void EmbeddingWorker::doDeferredIndex()
+{
+    //空闲时补建超出块数上限的文本块，每次只处理一批，不长时间占用工作线程
+    if (!d->isIdle())
         return;
 
-    if (d->embedder->doIndexDump(startID, endID)) {
-        d->indexer->doIndexDump();
-    }
+    int count = d->embedder->embeddingDeferredChunks(kDeferredBatchChunks);
+    if (count <= 0)
+        return;
+
+    if (!d->indexer->updateIndex(EmbeddingDim, d->embedder->getVectorStore()))
+        qWarning() << d->appID << "update deferred chunks index failed";
+    else
+        qInfo() << d->appID << "deferred chunks indexed:" << count;
 }
 
 void EmbeddingWorker::onCreateAllIndex()
 {
     d->m_creatingAll = true;
+    d->embedder->createEmbedDataTable();
     QString path = QStandardPaths::writableLocation(QStandardPaths::HomeLocation);
-    traverseAndCreate(path);
+
+    // 未变化的目录沿用上次遍历的子项
+    DirJournal journal(EmbeddingWorkerPrivate::workerDir() + QDir::separator() + d->appID + ".dirjournal");
+    journal.load();
+    traverseAndCreate(path, &journal);
+    if (d->m_creatingAll)
+        journal.save();
     d->m_creatingAll = false;
 }
 
-void EmbeddingWorker::traverseAndCreate(const QString &path)
+void EmbeddingWorker::traverseAndCreate(const QString &path, DirJournal *journal)
 {
     if (!d->m_creatingAll || d->isFilter(path))
         return;
 
-    const std::string tmp = path.toStdString();
-    const char *filePath = tmp.c_str();
-    struct stat st;
-    if (stat(filePath, &st) != 0)
-        return;
-
-    if (S_ISDIR(st.st_mode)) {
-        DIR *dir = nullptr;
-        if (!(dir = opendir(filePath))) {
-            qWarning() << "can not open: " << filePath;
-            return;
-        }
+    FileCrawler::Options opts;
+    opts.blacklist = ConfigManagerIns->value(BLACKLIST_GROUP, BLACKLIST_PATHS, QStringList()).toStringList();
+    opts.journal = journal;
 
-        struct dirent *dent = nullptr;
-        char fn[FILENAME_MAX] = { 0 };
-        strcpy(fn, filePath);
-        size_t len = strlen(filePath);
-        if (strcmp(filePath, "/"))
-            fn[len++] = '/';
+    FileCrawler crawler(opts);
+    crawler.start(path);
 
-        // traverse
-        while ((dent = readdir(dir)) && d->m_creatingAll) {
-            if (dent->d_name[0] == '.')
-                continue;
+    // 攒够一批再送入流水线，批与批之间检查是否已取消；已建过的文档不再上报状态
+    const int batchSize = d->createBatchSize();
+    QStringList batch;
+    auto flush = [this, &batch]() {
+        const QStringList docs = d->newDocuments(batch);
+        batch.clear();
+        if (!docs.isEmpty())
+            doCreateIndex(docs);
+    };
 
-            if (!strcmp(dent->d_name, ".") || !strcmp(dent->d_name, ".."))
-                continue;
-
-            strncpy(fn + len, dent->d_name, FILENAME_MAX - len);
-            traverseAndCreate(fn);
-        }
+    static const int maxFileSize = 50 * 1024 * 1024; //50MB
+    FileCrawler::Entry entry;
+    while (d->m_creatingAll && crawler.next(entry)) {
+        if (entry.st.st_size > maxFileSize || !d->isSupportDoc(entry.path))
+            continue;
 
-        if (dir)
-            closedir(dir);
-        return;
+        batch << entry.path;
+        if (batch.size() >= batchSize)
+            flush();
     }
 
-    static const int maxFileSize = 50 * 1024 * 1024; //50MB
-    if (QFileInfo(path).size() > maxFileSize)
-        return;
-
-    if (d->m_creatingAll)
-        doCreateIndex({path});
+    if (d->m_creatingAll && !batch.isEmpty())
+        flush();
 }
 
-QString EmbeddingWorker::doVectorSearch(const QString &query, int topK)
+QString EmbeddingWorker::doVectorSearch(const QString &query, int topK, int snippetLength)
 {
     if (query.isEmpty()) {
         qWarning() << "query is empty!";
         return {};
     }
-    return d->vectorSearch(query,topK);
+    return d->vectorSearch(query, topK, snippetLength);
 }
 
 QString EmbeddingWorker::getDocFile()
 {
     return d->getIndexDocs();
 }
+
+QString EmbeddingWorker::getDiagnostics()
+{
+    return d->diagnostics();
+}
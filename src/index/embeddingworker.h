@@ -13,6 +13,7 @@
 #include <QTimer>
 
 class EmbeddingWorkerPrivate;
+class DirJournal;
 class EmbeddingWorker : public QObject
 {
     Q_OBJECT
@@ -20,7 +21,7 @@ public:
     explicit EmbeddingWorker(const QString &appid, QObject *parent = nullptr);
     ~EmbeddingWorker();
 
-    void setEmbeddingApi(embeddingApi api, void *user);
+    void setEmbeddingClient(EmbeddingClient *client);
     void stop();
 
     void saveAllIndex();
@@ -28,8 +29,9 @@ public:
     void setWatch(bool watch);
     qint64 getIndexUpdateTime();
 public Q_SLOTS:
-    QString doVectorSearch(const QString &query, int topK);
+    QString doVectorSearch(const QString &query, int topK, int snippetLength = 0);
     QString getDocFile();
+    QString getDiagnostics();
 
     void onCreateAllIndex();
     bool doCreateIndex(const QStringList &files);
@@ -38,20 +40,24 @@ public Q_SLOTS:
     void onFileMonitorDelete(const QString &file);
 private Q_SLOTS:
     void doIndexDump();
+    void doDeferredIndex();
+    void doPendingCreate();
 //end
 
 signals:
     void statusChanged(const QString &key, const QStringList &files, int status);
     void indexCreateSuccess(const QString &key);
     void indexDeleted(const QString &key, const QStringList &files);
+    void indexProgress(const QString &key, int finished, int total);
 
     void stopEmbedding();
 private:
-    void traverseAndCreate(const QString &path);
+    void traverseAndCreate(const QString &path, DirJournal *journal = nullptr);
 private:
     EmbeddingWorkerPrivate *d { nullptr };
 
     QTimer dumpTimer;
+    QTimer deferTimer;
 };
 
 #endif // EMBEDDINGWORKER_H
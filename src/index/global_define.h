@@ -23,9 +23,14 @@ static constexpr char kSystemAssistantData[] { "/usr/share/deepin-systemassistan
 // DB
 static constexpr char kEmbeddingDBMetaDataTable[] { "embedding_metadata" };
 static constexpr char kEmbeddingDBIndexSegTable[] { "index_segment" };
+static constexpr char kEmbeddingDBVectorCacheTable[] { "embedding_cache" };   // 文本哈希 -> 向量
+static constexpr char kEmbeddingDBDeferredTable[] { "embedding_deferred" };   // 超出块数上限、待空闲时建索引的文本块
 static constexpr char kEmbeddingDBMetaDataTableID[] { "id" };
 static constexpr char kEmbeddingDBMetaDataTableSource[] { "source" };
 static constexpr char kEmbeddingDBMetaDataTableContent[] { "content" };
+static constexpr char kEmbeddingDBMetaDataTableStartIndex[] { "startIndex" };   // 文本块在解析后文本中的起始位置(UTF-16)
+static constexpr char kEmbeddingDBMetaDataTableLength[] { "length" };
+static constexpr char kEmbeddingDBVectorCacheLastUsed[] { "lastUsed" };   // 向量缓存最近命中或写入的时间(毫秒)
 
 static constexpr char kEmbeddingDBSegIndexTableBitSet[] { "deleteBit" };
 static constexpr char kEmbeddingDBSegIndexIndexName[] { "content" };
@@ -34,21 +39,34 @@ static constexpr char kEmbeddingDBSegIndexIndexName[] { "content" };
 static constexpr char kFaissFlatIndex[] { "Flat" };
 static constexpr char kFaissIvfFlatIndex[] { "IvfFlat" };
 static constexpr char kFaissIvfPQIndex[] { "IvfPQ" };
+static constexpr int kDefaultNProbe = 16;               // IVF检索的倒排表个数，越大召回越高、越慢
+static constexpr int kCompactSegmentsThreshold = 8;     // Flat段达到该数量后合并为IVF段
+static constexpr int kIvfMinTrainSize = 1024;           // 训练IVF所需的最少向量数
+static constexpr int kIvfPQThreshold = 100000;          // 向量数超过该值时使用IVF-PQ
 
 //embedding define
 static constexpr int kMaxChunksSize = 300;
 static constexpr int kMinChunksSize = 200;
+static constexpr int kMaxDocumentChunks = 100;          // 每个文档最多建索引的文本块数
+static constexpr int kIndexAppendChunks = 1000;          // 批量建索引时每累积这么多文本块追加一次缓存索引
+static constexpr int kDeferredBatchChunks = 200;         // 空闲时每次补建索引的文本块数
+static constexpr int kVectorCacheSize = 20000;           // 向量缓存最多保留的条数，超出时淘汰最久未用的
 
 //文档分块后的存储结构
 struct Document {
     QString content;
     QString source;
 
-    //int64_t startIndex; 文本块在文档内的起始索引(字符位置)，可以用于source定位。
+    qint64 startIndex = -1;   //文本块在文档内的起始索引(字符位置)，可以用于source定位。
+    qint64 length = 0;
     explicit Document(const QString &content = "",
-                      const QString &source = "")
+                      const QString &source = "",
+                      qint64 startIndex = -1,
+                      qint64 length = 0)
             : content(content),
-              source(source) {}
+              source(source),
+              startIndex(startIndex),
+              length(length) {}
 
     //Dynamic_cast
     virtual ~Document();
@@ -59,6 +77,7 @@ struct Document {
 #define INDEX_STATUS_CREATING_CODE 2
 #define INDEX_STATUS_DOCERROR_CODE -1
 #define INDEX_STATUS_DATAERROR_CODE -2
+#define INDEX_STATUS_CANCELED_CODE -3
 
 #define GET_INDEX_STATUS_CODE(status_info) (status_info##_CODE)
 #endif // GLOBAL_DEFINE_H
@@ -8,6 +8,7 @@
 #include "parser/videopropertyparser.h"
 #include "parser/imagepropertyparser.h"
 #include "config/configmanager.h"
+#include "utils/filecrawler.h"
 
 #include "analyzer/chineseanalyzer.h"
 
@@ -20,10 +21,14 @@
 #include <QDebug>
 #include <QDir>
 
-#include <dirent.h>
-
 using namespace Lucene;
 
+// 未提交的变更达到该数量或等待该时间后提交
+static constexpr int kCommitChanges = 1000;
+static constexpr int kCommitInterval = 5 * 1000;
+// 无变更持续该时间后合并索引段
+static constexpr int kOptimizeIdleTime = 10 * 60 * 1000;
+
 IndexWorkerPrivate::IndexWorkerPrivate(QObject *parent)
     : QObject(parent)
 {
@@ -31,6 +36,15 @@ IndexWorkerPrivate::IndexWorkerPrivate(QObject *parent)
     propertyParsers.insert("image/*", new ImagePropertyParser(this));
     propertyParsers.insert("audio/*", new AudioPropertyParser(this));
     propertyParsers.insert("video/*", new VideoPropertyParser(this));
+
+    // 作为子对象随工作者移入工作线程
+    commitTimer = new QTimer(this);
+    commitTimer->setSingleShot(true);
+    commitTimer->setInterval(kCommitInterval);
+
+    optimizeTimer = new QTimer(this);
+    optimizeTimer->setSingleShot(true);
+    optimizeTimer->setInterval(kOptimizeIdleTime);
 }
 
 bool IndexWorkerPrivate::indexExists()
@@ -59,55 +73,130 @@ Lucene::IndexReaderPtr IndexWorkerPrivate::newIndexReader()
     return IndexReader::open(FSDirectory::open(indexStoragePath().toStdWString()), true);
 }
 
-void IndexWorkerPrivate::doIndexTask(const Lucene::IndexWriterPtr &writer, const QString &file, IndexWorkerPrivate::IndexType type, bool isCheck)
+Lucene::IndexWriterPtr IndexWorkerPrivate::indexWriter()
 {
-    if (isStoped || isFilter(file))
+    if (writer)
+        return writer;
+
+    QDir dir;
+    if (!dir.exists(indexStoragePath()) && !dir.mkpath(indexStoragePath())) {
+        qWarning() << "Unable to create directory: " << indexStoragePath();
+        return Lucene::IndexWriterPtr();
+    }
+
+    // 段合并交给默认的合并策略在后台进行
+    writer = newIndexWriter(!indexExists());
+    return writer;
+}
+
+void IndexWorkerPrivate::addChanges(int count)
+{
+    if (count <= 0)
         return;
 
-    // limit file name length and level
-    if (file.size() > FILENAME_MAX - 1 || file.count('/') > 20)
+    if (pendingChanges == 0)
+        pendingTimer.start();
+    pendingChanges += count;
+    needOptimize = true;
+
+    if (pendingChanges >= kCommitChanges || pendingTimer.elapsed() >= kCommitInterval)
+        commit();
+    else if (!commitTimer->isActive())
+        commitTimer->start();
+}
+
+void IndexWorkerPrivate::commit()
+{
+    commitTimer->stop();
+    if (!writer || pendingChanges == 0)
         return;
 
-    const std::string tmp = file.toStdString();
-    const char *filePath = tmp.c_str();
-    struct stat st;
-    if (stat(filePath, &st) != 0)
+    try {
+        writer->commit();
+        qDebug() << "index commit" << pendingChanges << "changes";
+    } catch (const LuceneException &e) {
+        qWarning() << QString::fromStdWString(e.getError());
+    } catch (const std::exception &e) {
+        qWarning() << QString(e.what());
+    } catch (...) {
+        qWarning() << "The file index commit failed!";
+    }
+
+    pendingChanges = 0;
+    optimizeTimer->start();
+}
+
+void IndexWorkerPrivate::optimize()
+{
+    if (!writer || !needOptimize)
         return;
 
-    if (S_ISDIR(st.st_mode)) {
-        DIR *dir = nullptr;
-        if (!(dir = opendir(filePath))) {
-            qWarning() << "can not open: " << filePath;
-            return;
-        }
+    commit();
+    try {
+        QElapsedTimer timer;
+        timer.start();
+        writer->optimize();
+        writer->commit();
+        needOptimize = false;
+        qInfo() << "optimize index spending: " << timer.elapsed();
+    } catch (const LuceneException &e) {
+        qWarning() << QString::fromStdWString(e.getError());
+    } catch (const std::exception &e) {
+        qWarning() << QString(e.what());
+    } catch (...) {
+        qWarning() << "The file index optimize failed!";
+    }
+}
 
-        struct dirent *dent = nullptr;
-        char fn[FILENAME_MAX] = { 0 };
-        strcpy(fn, filePath);
-        size_t len = strlen(filePath);
-        if (strcmp(filePath, "/"))
-            fn[len++] = '/';
+void IndexWorkerPrivate::closeWriter()
+{
+    // close会提交未提交的变更
+    if (!writer)
+        return;
 
-        // traverse
-        while ((dent = readdir(dir)) && !isStoped) {
-            if (dent->d_name[0] == '.')
-                continue;
+    try {
+        writer->close();
+    } catch (const LuceneException &e) {
+        qWarning() << QString::fromStdWString(e.getError());
+    } catch (...) {
+        qWarning() << "The file index close failed!";
+    }
 
-            if (!strcmp(dent->d_name, ".") || !strcmp(dent->d_name, ".."))
-                continue;
+    writer.reset();
+    pendingChanges = 0;
+}
 
-            strncpy(fn + len, dent->d_name, FILENAME_MAX - len);
-            doIndexTask(writer, fn, type, isCheck);
-        }
+void IndexWorkerPrivate::doIndexTask(const Lucene::IndexWriterPtr &writer, const QString &file, IndexWorkerPrivate::IndexType type, bool isCheck,
+                                     DirJournal *journal)
+{
+    if (isStoped || isFilter(file))
+        return;
 
-        if (dir)
-            closedir(dir);
+    // limit file name length and level
+    if (file.size() > FILENAME_MAX - 1 || file.count('/') > 20)
         return;
+
+    FileCrawler::Options opts;
+    opts.blacklist = ConfigManagerIns->value(BLACKLIST_GROUP, BLACKLIST_PATHS, QStringList()).toStringList();
+    opts.maxDepth = 20 - file.count('/');
+    opts.journal = journal;
+
+    FileCrawler crawler(opts);
+    crawler.start(file);
+
+    FileCrawler::Entry entry;
+    while (!isStoped && crawler.next(entry)) {
+        if (entry.path.size() > FILENAME_MAX - 1)
+            continue;
+
+        IndexType fileType = type;
+        if (isCheck && !checkUpdate(entry.path, entry.st, fileType))
+            continue;
+        indexFile(writer, entry.path, fileType);
     }
 
-    if (isCheck && !checkUpdate(writer->getReader(), file, type))
-        return;
-    indexFile(writer, file, type);
+    if (journal)
+        qInfo() << "dirs reused from journal:" << crawler.reusedDirCount() << "/" << journal->size();
 }
 
 void IndexWorkerPrivate::indexFile(Lucene::IndexWriterPtr writer, const QString &file, IndexWorkerPrivate::IndexType type)
@@ -131,6 +220,7 @@ void IndexWorkerPrivate::indexFile(Lucene::IndexWriterPtr writer, const QString
             break;
         }
         }
+        addChanges(1);
 
     } catch (const LuceneException &e) {
         QMetaEnum enumType = QMetaEnum::fromType<IndexWorkerPrivate::IndexType>();
@@ -143,42 +233,96 @@ void IndexWorkerPrivate::indexFile(Lucene::IndexWriterPtr writer, const QString
     }
 }
 
-bool IndexWorkerPrivate::checkUpdate(const IndexReaderPtr &reader, const QString &file, IndexWorkerPrivate::IndexType &type)
+bool IndexWorkerPrivate::checkUpdate(const QString &file, const struct stat &st, IndexWorkerPrivate::IndexType &type)
 {
-    Q_ASSERT(reader);
+    auto it = snapshot.find(file);
+    if (it == snapshot.end()) {
+        type = CreateIndex;
+        return true;
+    }
+
+    it->visited = true;
+    // 与索引中lastModified的格式一致
+    const QString lastModified = QDateTime::fromSecsSinceEpoch(st.st_mtime).toString("yyyyMMddHHmmss");
+    if (lastModified != it->lastModified || static_cast<qint64>(st.st_size) != it->size) {
+        type = UpdateIndex;
+        return true;
+    }
+
+    return false;
+}
+
+bool IndexWorkerPrivate::loadSnapshot()
+{
+    snapshot.clear();
 
+    // 先提交未提交的变更，读取的是已提交的索引
+    commit();
     try {
-        SearcherPtr searcher = newLucene<IndexSearcher>(reader);
-        TermQueryPtr query = newLucene<TermQuery>(newLucene<Term>(L"path", file.toStdWString()));
-
-        // 文件路径为唯一值，所以搜索一个结果就行了
-        TopDocsPtr topDocs = searcher->search(query, 1);
-        int32_t numTotalHits = topDocs->totalHits;
-        if (numTotalHits == 0) {
-            type = CreateIndex;
-            return true;
-        } else {
-            DocumentPtr doc = searcher->doc(topDocs->scoreDocs[0]->doc);
-            QFileInfo info(file);
-            QString lastModified = info.lastModified().toString("yyyyMMddHHmmss");
-            String storeTime = doc->get(L"lastModified");
-
-            if (lastModified.toStdWString() != storeTime) {
-                type = UpdateIndex;
-                return true;
-            }
+        QElapsedTimer timer;
+        timer.start();
+        IndexReaderPtr reader = newIndexReader();
+        const int32_t maxDoc = reader->maxDoc();
+        snapshot.reserve(reader->numDocs());
+        for (int32_t i = 0; i < maxDoc && !isStoped; ++i) {
+            if (reader->isDeleted(i))
+                continue;
+
+            DocumentPtr doc = reader->document(i);
+            FileStamp stamp;
+            stamp.lastModified = QString::fromStdWString(doc->get(L"lastModified"));
+            stamp.size = QString::fromStdWString(doc->get(L"size")).toLongLong();
+            snapshot.insert(QString::fromStdWString(doc->get(L"path")), stamp);
         }
+        reader->close();
+
+        qInfo() << "load index snapshot spending: " << timer.elapsed() << snapshot.size();
+        return !isStoped;
     } catch (const LuceneException &e) {
-        qWarning() << QString::fromStdWString(e.getError()) << " file: " << file;
+        qWarning() << QString::fromStdWString(e.getError());
     } catch (const std::exception &e) {
-        qWarning() << QString(e.what()) << " file: " << file;
+        qWarning() << QString(e.what());
     } catch (...) {
-        qWarning() << "The file checked failed!" << file;
+        qWarning() << "Load index snapshot failed!";
     }
 
+    snapshot.clear();
     return false;
 }
 
+void IndexWorkerPrivate::removeUnvisited(const Lucene::IndexWriterPtr &writer)
+{
+    // 未遍历到的文件可能已删除，也可能被过滤(隐藏文件等)，确认不存在后才删除
+    static constexpr int kDeleteBatch = 1000;
+    Collection<TermPtr> terms = Collection<TermPtr>::newInstance();
+    int removed = 0;
+    for (auto it = snapshot.constBegin(); it != snapshot.constEnd() && !isStoped; ++it) {
+        if (it->visited)
+            continue;
+
+        struct stat st;
+        if (lstat(it.key().toStdString().c_str(), &st) == 0)
+            continue;
+
+        terms.add(newLucene<Term>(L"path", it.key().toStdWString()));
+        if (terms.size() >= kDeleteBatch) {
+            writer->deleteDocuments(terms);
+            addChanges(terms.size());
+            removed += terms.size();
+            terms = Collection<TermPtr>::newInstance();
+        }
+    }
+
+    if (!terms.empty()) {
+        writer->deleteDocuments(terms);
+        addChanges(terms.size());
+        removed += terms.size();
+    }
+
+    if (removed > 0)
+        qInfo() << "remove deleted files from index: " << removed;
+}
+
 Lucene::DocumentPtr IndexWorkerPrivate::indexDocument(const QString &file)
 {
     DocumentPtr doc = newLucene<Document>();
@@ -218,6 +362,14 @@ IndexWorker::IndexWorker(QObject *parent)
     : QObject(parent),
       d(new IndexWorkerPrivate(this))
 {
+    connect(d->commitTimer, &QTimer::timeout, this, &IndexWorker::onCommitTimeout);
+    connect(d->optimizeTimer, &QTimer::timeout, this, &IndexWorker::onOptimizeTimeout);
+}
+
+IndexWorker::~IndexWorker()
+{
+    // 工作线程已退出，提交剩余变更并释放写锁
+    d->closeWriter();
 }
 
 void IndexWorker::start()
@@ -228,6 +380,9 @@ void IndexWorker::start()
 void IndexWorker::stop()
 {
     d->isStoped = true;
+
+    // 在工作线程中提交已有的变更
+    QMetaObject::invokeMethod(this, [this]() { d->commit(); }, Qt::QueuedConnection);
 }
 
 void IndexWorker::onFileAttributeChanged(const QString &file)
@@ -236,10 +391,12 @@ void IndexWorker::onFileAttributeChanged(const QString &file)
         return;
 
     try {
-        IndexWriterPtr writer = d->newIndexWriter();
+        IndexWriterPtr writer = d->indexWriter();
+        if (!writer)
+            return;
+
+        d->indexFileCount = 0;
         d->doIndexTask(writer, file, IndexWorkerPrivate::UpdateIndex);
-        writer->optimize();
-        writer->close();
     } catch (const LuceneException &e) {
         qWarning() << QString::fromStdWString(e.getError());
     } catch (const std::exception &e) {
@@ -254,23 +411,16 @@ void IndexWorker::onFileCreated(const QString &file)
     if (d->isStoped)
         return;
 
-    QDir dir;
-    if (!dir.exists(d->indexStoragePath())) {
-        if (!dir.mkpath(d->indexStoragePath())) {
-            qWarning() << "Unable to create directory: " << d->indexStoragePath();
-            return;
-        }
-    }
-
     try {
         // record spending
         QTime timer;
         timer.start();
+        IndexWriterPtr writer = d->indexWriter();
+        if (!writer)
+            return;
+
         d->indexFileCount = 0;
-        IndexWriterPtr writer = d->newIndexWriter(!d->indexExists());
         d->doIndexTask(writer, file, IndexWorkerPrivate::CreateIndex);
-        writer->optimize();
-        writer->close();
 
         qInfo() << "create index spending: " << timer.elapsed() << d->indexFileCount;
     } catch (const LuceneException &e) {
@@ -289,7 +439,9 @@ void IndexWorker::onFileDeleted(const QString &file)
 
     try {
         qDebug() << "Delete file: [" << file << "]";
-        IndexWriterPtr writer = d->newIndexWriter();
+        IndexWriterPtr writer = d->indexWriter();
+        if (!writer)
+            return;
 
         QFileInfo info(file);
         if (info.isDir()) {
@@ -301,8 +453,7 @@ void IndexWorker::onFileDeleted(const QString &file)
             writer->deleteDocuments(term);
         }
 
-        writer->optimize();
-        writer->close();
+        d->addChanges(1);
     } catch (const LuceneException &e) {
         qWarning() << QString::fromStdWString(e.getError());
     } catch (const std::exception &e) {
@@ -332,10 +483,27 @@ void IndexWorker::onUpdateAllIndex()
 
     const auto &path = QStandardPaths::writableLocation(QStandardPaths::HomeLocation);
     try {
-        IndexWriterPtr writer = d->newIndexWriter();
-        d->doIndexTask(writer, path, IndexWorkerPrivate::UpdateIndex, true);
-        writer->optimize();
-        writer->close();
+        IndexWriterPtr writer = d->indexWriter();
+        if (!writer || !d->loadSnapshot())
+            return;
+
+        // 遍历时在内存中比对，新增/修改直接写入，删除在遍历结束后批量处理
+        QElapsedTimer timer;
+        timer.start();
+        d->indexFileCount = 0;
+
+        // 未变化的目录沿用上次遍历的子项，只检查其中文件的状态
+        DirJournal journal(IndexWorkerPrivate::indexStoragePath() + ".dirjournal");
+        journal.load();
+        d->doIndexTask(writer, path, IndexWorkerPrivate::UpdateIndex, true, &journal);
+        if (!d->isStoped) {
+            d->removeUnvisited(writer);
+            journal.save();
+        }
+        d->snapshot.clear();
+        d->commit();
+
+        qInfo() << "update index spending: " << timer.elapsed() << d->indexFileCount;
     } catch (const LuceneException &e) {
         qWarning() << QString::fromStdWString(e.getError());
     } catch (const std::exception &e) {
@@ -344,3 +512,17 @@ void IndexWorker::onUpdateAllIndex()
         qWarning() << "The file index updated failed!";
     }
 }
+
+void IndexWorker::onCommitTimeout()
+{
+    d->commit();
+}
+
+void IndexWorker::onOptimizeTimeout()
+{
+    // 空闲维护：长时间没有变更时才合并索引段
+    if (d->isStoped)
+        return;
+
+    d->optimize();
+}
@@ -13,6 +13,7 @@ class IndexWorker : public QObject
     Q_OBJECT
 public:
     explicit IndexWorker(QObject *parent = nullptr);
+    ~IndexWorker();
     void start();
     void stop();
 
@@ -23,6 +24,10 @@ public Q_SLOTS:
     void onCreateAllIndex();
     void onUpdateAllIndex();
 
+private Q_SLOTS:
+    void onCommitTimeout();
+    void onOptimizeTimeout();
+
 private:
     IndexWorkerPrivate *d { nullptr };
 };
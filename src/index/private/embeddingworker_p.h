@@ -13,6 +13,11 @@
 #include <QSqlDatabase>
 #include <QMutex>
 #include <QThread>
+#include <QThreadPool>
+#include <QTimer>
+#include <QAtomicInt>
+#include <QJsonObject>
+#include <QElapsedTimer>
 
 class EmbeddingWorkerPrivate : public QObject
 {
@@ -38,13 +43,25 @@ public:
 
     int updateIndex(const QStringList &files);
     bool deleteIndex(const QStringList &files);
-    QString vectorSearch(const QString &query, int topK);
+    bool isIdle();
+    QString vectorSearch(const QString &query, int topK, int snippetLength = 0);
+
+    QString diagnostics();
 
     QString indexDir();
     QString getIndexDocs();
 
     bool isSupportDoc(const QString &file);
     bool isFilter(const QString &file);
+
+    // 一次送入流水线的文档数，保证解析、分块与向量化能并行
+    inline int createBatchSize() const { return qMax(16, parsePool.maxThreadCount() * 4); }
+    // 过滤掉已建过索引的文档
+    QStringList newDocuments(const QStringList &files);
+
+signals:
+    void progressChanged(int finished, int total);
+
 public:
     Embedding *embedder {nullptr};
     VectorIndex *indexer {nullptr};
@@ -57,8 +74,20 @@ public:
     QString appID;
     QThread workThread;
 
+    // 文档解析、分块与提交向量化的线程池
+    QThreadPool parsePool;
+    QAtomicInt cancelled { 0 };
+    QElapsedTimer lastActive;   // 最近一次建索引/删除请求
+
+    // 文件监控的新建事件合并后成批建索引
+    QStringList pendingCreates;
+    QTimer *createTimer { nullptr };
+
     QSqlDatabase dataBase;
     QMutex dbMtx;
+
+    QJsonObject lastSearchTiming;
+    QMutex diagnosticsMtx;
 };
 
 #endif // VECTORWORKER_P_H
@@ -9,13 +9,19 @@
 
 #include <lucene++/LuceneHeaders.h>
 
+#include <sys/stat.h>
+
 #include <QStandardPaths>
 #include <QObject>
 #include <QMap>
+#include <QHash>
+#include <QTimer>
+#include <QElapsedTimer>
 
 #include <QDebug>
 
 class AbstractPropertyParser;
+class DirJournal;
 class IndexWorkerPrivate : public QObject
 {
     Q_OBJECT
@@ -33,6 +39,13 @@ public:
     Lucene::IndexWriterPtr newIndexWriter(bool create = false);
     Lucene::IndexReaderPtr newIndexReader();
 
+    // 常驻的IndexWriter，变更累积到一定数量或时间后统一提交
+    Lucene::IndexWriterPtr indexWriter();
+    void addChanges(int count);
+    void commit();
+    void optimize();
+    void closeWriter();
+
     inline static QString indexStoragePath()
     {
         static QString indexPath = QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
@@ -40,15 +53,33 @@ public:
         return indexPath;
     }
 
-    void doIndexTask(const Lucene::IndexWriterPtr &writer, const QString &file, IndexType type, bool isCheck = false);
+    // 索引中已有文件的状态，用于全量更新时在内存中比对
+    struct FileStamp {
+        QString lastModified;
+        qint64 size = -1;
+        bool visited = false;
+    };
+
+    void doIndexTask(const Lucene::IndexWriterPtr &writer, const QString &file, IndexType type, bool isCheck = false,
+                     DirJournal *journal = nullptr);
     void indexFile(Lucene::IndexWriterPtr writer, const QString &file, IndexType type);
-    bool checkUpdate(const Lucene::IndexReaderPtr &reader, const QString &file, IndexType &type);
+    bool checkUpdate(const QString &file, const struct stat &st, IndexType &type);
+    bool loadSnapshot();
+    void removeUnvisited(const Lucene::IndexWriterPtr &writer);
     Lucene::DocumentPtr indexDocument(const QString &file);
     QList<AbstractPropertyParser::Property> fileProperties(const QString &file);
 
     QMap<QString, AbstractPropertyParser *> propertyParsers;
     quint32 indexFileCount { 0 };
     std::atomic_bool isStoped { true };
+
+    Lucene::IndexWriterPtr writer;
+    QHash<QString, FileStamp> snapshot;   // 仅在全量更新期间有效
+    int pendingChanges { 0 };
+    bool needOptimize { false };
+    QElapsedTimer pendingTimer;      // 最早一次未提交变更的时间
+    QTimer *commitTimer { nullptr };
+    QTimer *optimizeTimer { nullptr };   // 空闲一段时间后再合并索引段
 };
 
 #endif   // INDEXWORKER_P_H
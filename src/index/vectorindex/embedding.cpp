@@ -4,25 +4,32 @@
 
 #include "embedding.h"
 #include "vectorindex.h"
+#include "textchunker.h"
 #include "database/embeddatabase.h"
+#include "config/configmanager.h"
 #include "../global_define.h"
 #include "utils/utils.h"
 
-#include <QRegularExpression>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QFile>
 #include <QDebug>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QCryptographicHash>
 #include <QtConcurrent/QtConcurrent>
 
 #include <docparser.h>
 
+#include <cstring>
+
 static constexpr char kSearchResultDistance[] { "distance" };
 
 Embedding::Embedding(QSqlDatabase *db, QMutex *mtx, const QString &appID, QObject *parent)
     : QObject(parent)
+    , vectorStore(EmbeddingDim)
     , dataBase(db)
     , dbMtx(mtx)
     , appID(appID)
@@ -32,6 +39,26 @@ Embedding::Embedding(QSqlDatabase *db, QMutex *mtx, const QString &appID, QObjec
 }
 
 bool Embedding::embeddingDocument(const QString &docFilePath)
+{
+    PendingDocument doc;
+    if (!submitDocument(docFilePath, false, doc))
+        return false;
+
+    return finishDocument(doc);
+}
+
+bool Embedding::embeddingDocumentSaveAs(const QString &docFilePath)
+{
+    // Embedding SaveAs
+    // uos-ai
+    PendingDocument doc;
+    if (!submitDocument(docFilePath, true, doc))
+        return false;
+
+    return finishDocument(doc);
+}
+
+bool Embedding::submitDocument(const QString &docFilePath, bool saveAs, PendingDocument &doc, bool checkDup)
 {
     QFileInfo docFile(docFilePath);
     if (!docFile.exists()) {
@@ -39,14 +66,18 @@ bool Embedding::embeddingDocument(const QString &docFilePath)
         return false;
     }
 
-    if (isDupDocument(docFilePath)) {
-        qWarning() << docFilePath << "dump doc duplicate";
+    QString source = documentSource(docFilePath, saveAs);
+
+    // 批量提交时调用方已统一检查过
+    if (checkDup && isDupDocument(source)) {
+        qWarning() << source << "dump doc duplicate";
         return false;
     }
 
-    for (auto id : embedDataCache.keys()) {
-        if (docFilePath == embedDataCache.value(id).first) {
-            qWarning() << docFilePath << "cache doc duplicate";
+    {
+        QMutexLocker lk(&embeddingMutex);
+        if (sourceIds.contains(source)) {
+            qWarning() << source << "cache doc duplicate";
             return false;
         }
     }
@@ -59,147 +90,404 @@ bool Embedding::embeddingDocument(const QString &docFilePath)
         return false;
     }
 
-    //文本分块
-    QStringList chunks;
-    if (!contents.isEmpty())
-        chunks = textsSpliter(contents);
+    if (saveAs && contents.isEmpty())
+        return false;
 
     // 文件名大于14字节建索引
-    if (docFile.baseName().toUtf8().size() > 14) {
+    const bool nameChunk = !saveAs && docFile.baseName().toUtf8().size() > 14;
+
+    //文本分块，块数超出上限时按策略选取优先建索引的块，其余留待空闲时补建
+    const ChunkPolicy policy = chunkPolicy();
+    int maxChunks = -1;
+    if (!saveAs && policy.maxChunks > 0)
+        maxChunks = nameChunk ? qMax(policy.maxChunks - 1, 0) : policy.maxChunks;
+
+    QStringList chunks;
+    QVector<QPair<qint64, qint64>> offsets;
+    doc.deferredChunks.clear();
+    doc.deferredOffsets.clear();
+    if (!contents.isEmpty()) {
+        // 只取开头且不补建时，达到上限即停止扫描
+        const bool scanAll = policy.sampling != TextChunker::Head || policy.deferRemaining;
+        const QList<TextChunk> textChunks = TextChunker::split(contents, scanAll ? -1 : maxChunks);
+
+        QVector<bool> selected(textChunks.size(), true);
+        if (maxChunks >= 0 && textChunks.size() > maxChunks) {
+            selected.fill(false);
+            for (int i : TextChunker::sample(contents, textChunks, maxChunks, policy.sampling))
+                selected[i] = true;
+            qDebug() << "Get" << maxChunks << "of" << textChunks.size() << "chunks" << docFilePath;
+        }
+
+        for (int i = 0; i < textChunks.size(); i++) {
+            const TextChunk &chunk = textChunks.at(i);
+            const QPair<qint64, qint64> offset(chunk.start, chunk.length);
+            if (selected.at(i)) {
+                chunks << chunk.text;
+                offsets << offset;
+            } else if (policy.deferRemaining) {
+                doc.deferredChunks << chunk.text;
+                doc.deferredOffsets << offset;
+            }
+        }
+    }
+
+    // 文件名块不在正文中，起始位置记为-1
+    if (nameChunk) {
         chunks.prepend(docFile.fileName());
+        offsets.prepend(qMakePair(qint64(-1), qint64(0)));
     }
 
     if (chunks.isEmpty())
         return false;
 
-    qDebug() << "embedding " << docFilePath << chunks.size();
-    // 只需前100个
-    if (chunks.size() > 100) {
-        chunks = chunks.mid(0, 100);
-        qDebug() << "Get the top 100 chunks" << docFilePath;
-    }
+    qDebug() << "embedding " << source << chunks.size();
 
-    //向量化文本块，生成向量vector
-    QVector<QVector<float>> vectors;
-    vectors = embeddingTexts(chunks);
+    //提交向量化请求，结果在finishDocument中取回
+    doc.source = source;
+    doc.chunks = chunks;
+    doc.offsets = offsets;
+    submitChunks(doc);
+    return true;
+}
 
-    if (vectors.count() != chunks.count())
-        return false;
-    if (vectors.isEmpty())
+bool Embedding::finishDocument(PendingDocument &doc)
+{
+    //向量化文本块，生成向量vector
+    if (doc.chunks.isEmpty() || !collectVectors(doc))
         return false;
 
     {
         QMutexLocker lk(&embeddingMutex);
-        //元数据、文本存储
-        int continueID = embedDataCache.size() + getDBLastID();
+        //元数据、文本存储，向量直接追加到连续存储中
+        //id单调递增，删除留下的空洞不会被复用
+        if (nextID < 0)
+            nextID = getDBLastID();
+        if (!embedDataCache.isEmpty())
+            nextID = qMax(nextID, embedDataCache.lastKey() + 1);
+        faiss::idx_t continueID = nextID;
         qInfo() << "-------------" << continueID;
 
-        for (int i = 0; i < chunks.count(); i++) {
-            if (chunks[i].isEmpty())
+        for (int i = 0; i < doc.chunks.count(); i++) {
+            if (doc.chunks[i].isEmpty())
                 continue;
 
-            embedDataCache.insert(continueID, QPair<QString, QString>(docFilePath, chunks[i]));
-            embedVectorCache.insert(continueID, vectors[i]);
+            embedDataCache.insert(continueID, QPair<QString, QString>(doc.source, doc.chunks[i]));
+            sourceIds[doc.source] << continueID;
+            if (i < doc.offsets.size())
+                chunkOffsets.insert(continueID, doc.offsets.at(i));
+            vectorStore.append(continueID, doc.vectors.data() + static_cast<size_t>(i) * EmbeddingDim);
 
             continueID += 1;
         }
+        nextID = continueID;
     }
+
+    if (!doc.deferredChunks.isEmpty())
+        saveDeferredChunks(doc);
     return true;
 }
 
-bool Embedding::embeddingDocumentSaveAs(const QString &docFilePath)
+Embedding::ChunkPolicy Embedding::chunkPolicy() const
 {
-    // Embedding SaveAs
-    // uos-ai
-    QFileInfo docFile(docFilePath);
-    if (!docFile.exists()) {
-        qWarning() << docFilePath << "not exist";
-        return false;
+    //应用单独的配置优先于全局配置
+    auto value = [this](const QString &key, const QVariant &defaultValue) {
+        const QVariant global = ConfigManagerIns->value(VECTOR_INDEX_GROUP, key, defaultValue);
+        return ConfigManagerIns->value(VECTOR_INDEX_GROUP, appID + "." + key, global);
+    };
+
+    ChunkPolicy policy;
+    policy.maxChunks = value(VECTOR_INDEX_MAX_CHUNKS, kMaxDocumentChunks).toInt();
+    policy.sampling = TextChunker::samplingFromString(value(VECTOR_INDEX_CHUNK_SAMPLING, "head").toString());
+    policy.deferRemaining = value(VECTOR_INDEX_DEFER_REMAINING, true).toBool();
+    return policy;
+}
+
+void Embedding::saveDeferredChunks(const PendingDocument &doc)
+{
+    QVariantList sources;
+    QVariantList contents;
+    QVariantList starts;
+    QVariantList lengths;
+    for (int i = 0; i < doc.deferredChunks.size(); i++) {
+        sources << doc.source;
+        contents << doc.deferredChunks.at(i);
+        starts << doc.deferredOffsets.at(i).first;
+        lengths << doc.deferredOffsets.at(i).second;
     }
 
-    QString newDocPath = saveAsDocPath(docFilePath);
+    QString insert = "INSERT INTO " + QString(kEmbeddingDBDeferredTable) + " (source, content, "
+            + QString(kEmbeddingDBMetaDataTableStartIndex) + ", " + QString(kEmbeddingDBMetaDataTableLength)
+            + ") VALUES (?, ?, ?, ?)";
+    if (!batchInsertDataToDB(insert, { sources, contents, starts, lengths }))
+        qWarning() << "Insert deferred chunks failed." << doc.source;
+    else
+        deferredState.storeRelease(1);
+}
 
-    if (isDupDocument(newDocPath)) {
-        qWarning() << newDocPath << "dump doc duplicate";
-        return false;
+int Embedding::embeddingDeferredChunks(int limit)
+{
+    //启动后首次检查表是否存在，之后只在有待补建的块时查询
+    if (deferredState.loadAcquire() < 0) {
+        QMutexLocker lk(dbMtx);
+        deferredState.storeRelease(EmbedDBVendorIns->isEmbedDataTableExists(dataBase, kEmbeddingDBDeferredTable) ? 1 : 0);
     }
+    if (deferredState.loadAcquire() == 0)
+        return 0;
 
-    for (auto id : embedDataCache.keys()) {
-        if (newDocPath == embedDataCache.value(id).first) {
-            qWarning() << newDocPath << "cache doc duplicate";
-            return false;
+    QList<QVariantList> result;
+    {
+        QString query = "SELECT id, source, content, " + QString(kEmbeddingDBMetaDataTableStartIndex) + ", "
+                + QString(kEmbeddingDBMetaDataTableLength) + " FROM " + QString(kEmbeddingDBDeferredTable)
+                + " ORDER BY id LIMIT " + QString::number(limit);
+        QMutexLocker lk(dbMtx);
+        EmbedDBVendorIns->executeQuery(dataBase, query, result);
+    }
+
+    //按来源组成文档，全部提交后再依次取回
+    QList<QSharedPointer<PendingDocument>> docs;
+    QList<QVariantList> docRows;   // 与docs对应的行id
+    QHash<QString, int> bySource;
+    for (const QVariantList &res : result) {
+        if (res.size() < 5 || !res[0].isValid())
+            continue;
+
+        const QString source = res[1].toString();
+        int pos = bySource.value(source, -1);
+        if (pos < 0) {
+            pos = docs.size();
+            QSharedPointer<PendingDocument> doc(new PendingDocument);
+            doc->source = source;
+            docs << doc;
+            docRows << QVariantList();
+            bySource.insert(source, pos);
         }
+        docs[pos]->chunks << res[2].toString();
+        docs[pos]->offsets << qMakePair(res[3].toLongLong(), res[4].toLongLong());
+        docRows[pos] << res[0];
     }
 
-    std::string stdStrContents = DocParser::convertFile(docFilePath.toStdString());
-    QString contents = Utils::textEncodingTransferUTF8(stdStrContents);
+    if (docs.isEmpty()) {
+        deferredState.storeRelease(0);
+        return 0;
+    }
 
-    if (!Utils::isValidContent(stdStrContents)) {
-        qDebug() << "Invalid document content.";
-        return false;
+    for (const QSharedPointer<PendingDocument> &doc : docs)
+        submitChunks(*doc);
+
+    //失败的文档保留在表中，下次空闲时重试
+    QVariantList rowIds;
+    for (int i = 0; i < docs.size(); i++) {
+        if (finishDocument(*docs[i]))
+            rowIds << docRows.at(i);
     }
+    if (rowIds.isEmpty())
+        return -1;
 
-    if (contents.isEmpty())
-        return false;
-    qInfo() << "embedding " << newDocPath;
+    //已取回的块移出待补建表
+    QMutexLocker lk(dbMtx);
+    for (int pos = 0; pos < rowIds.size(); pos += EmbedDBVendor::kMaxBindValues) {
+        QVariantList ids = rowIds.mid(pos, EmbedDBVendor::kMaxBindValues);
+        QString remove = "DELETE FROM " + QString(kEmbeddingDBDeferredTable) + " WHERE id IN ("
+                + EmbedDBVendor::inPlaceholders(ids) + ")";
+        QList<QVariantList> unused;
+        EmbedDBVendorIns->executePreparedQuery(dataBase, remove, ids, unused);
+    }
+
+    return rowIds.size();
+}
+
+void Embedding::deleteDeferredChunks(const QStringList &files)
+{
+    QMutexLocker lk(dbMtx);
+    for (int pos = 0; pos < files.size(); pos += EmbedDBVendor::kMaxBindValues) {
+        QVariantList sources;
+        for (const QString &file : files.mid(pos, EmbedDBVendor::kMaxBindValues))
+            sources << file;
+
+        QString remove = "DELETE FROM " + QString(kEmbeddingDBDeferredTable) + " WHERE source IN ("
+                + EmbedDBVendor::inPlaceholders(sources) + ")";
+        QList<QVariantList> unused;
+        EmbedDBVendorIns->executePreparedQuery(dataBase, remove, sources, unused);
+    }
+}
+
+QVector<QVector<float>> Embedding::embeddingTexts(const QStringList &texts)
+{
+    if (texts.isEmpty() || !embeddingClient)
+        return {};
+
+    //多个批次同时在途
+    PendingDocument doc;
+    doc.chunks = texts;
+    submitChunks(doc);
+    if (!collectVectors(doc))
+        return {};
 
-    //文本分块
-    QStringList chunks;
-    chunks = textsSpliter(contents);
-    //向量化文本块，生成向量vector
     QVector<QVector<float>> vectors;
-    vectors = embeddingTexts(chunks);
+    for (int i = 0; i < texts.size(); i++) {
+        const float *vector = doc.vectors.data() + static_cast<size_t>(i) * EmbeddingDim;
+        vectors << QVector<float>(vector, vector + EmbeddingDim);
+    }
+    return vectors;
+}
 
-    if (vectors.count() != chunks.count())
-        return false;
-    if (vectors.isEmpty())
-        return false;
+void Embedding::submitChunks(PendingDocument &doc)
+{
+    //先查向量缓存，只提交未命中的文本块
+    lookupVectorCache(doc);
 
-    {
-        QMutexLocker lk(&embeddingMutex);
-        //元数据、文本存储
-        int continueID = embedDataCache.size() + getDBLastID();
-        qInfo() << "-------------" << continueID;
+    QStringList missTexts;
+    doc.misses.clear();
+    for (int i = 0; i < doc.chunks.size(); i++) {
+        if (doc.ready.at(i))
+            continue;
+        doc.misses << i;
+        missTexts << doc.chunks.at(i);
+    }
 
-        for (int i = 0; i < chunks.count(); i++) {
-            if (chunks[i].isEmpty())
-                continue;
+    cacheHits += doc.chunks.size() - doc.misses.size();
+    cacheMisses += doc.misses.size();
 
-            embedDataCache.insert(continueID, QPair<QString, QString>(newDocPath, chunks[i]));
-            embedVectorCache.insert(continueID, vectors[i]);
+    if (embeddingClient && !missTexts.isEmpty())
+        doc.batches = embeddingClient->embed(missTexts);
+}
 
-            continueID += 1;
+bool Embedding::collectVectors(PendingDocument &doc)
+{
+    //批次按长度分组提交，按原顺序放回；任一批失败则整体失败
+    QVariantList hashes;
+    QVariantList blobs;
+    for (const EmbeddingClient::Batch &batch : doc.batches) {
+        const EmbeddingResult result = batch.reply.result();
+        if (result.count != batch.indexes.size() || result.dim != EmbeddingDim)
+            return false;
+
+        for (int i = 0; i < result.count; i++) {
+            const int pos = doc.misses.at(batch.indexes.at(i));
+            const float *vector = result.vector(i);
+            memcpy(doc.vectors.data() + static_cast<size_t>(pos) * EmbeddingDim, vector, sizeof(float) * EmbeddingDim);
+            doc.ready[pos] = true;
+
+            if (pos < doc.hashes.size()) {
+                hashes << doc.hashes.at(pos);
+                blobs << QByteArray(reinterpret_cast<const char *>(vector),
+                                    EmbeddingDim * static_cast<int>(sizeof(float)));
+            }
         }
     }
+    doc.batches.clear();
+
+    if (doc.ready.contains(false))
+        return false;
+
+    //新向量写入缓存
+    if (!hashes.isEmpty()) {
+        const QVariantList lastUsed = QVector<QVariant>(hashes.size(), QDateTime::currentMSecsSinceEpoch()).toList();
+        QString insert = "INSERT OR IGNORE INTO " + QString(kEmbeddingDBVectorCacheTable) + " (hash, vector, "
+                + QString(kEmbeddingDBVectorCacheLastUsed) + ") VALUES (?, ?, ?)";
+        if (!batchInsertDataToDB(insert, { hashes, blobs, lastUsed }))
+            qWarning() << "Insert embedding cache failed.";
+    }
 
     return true;
 }
 
-QVector<QVector<float>> Embedding::embeddingTexts(const QStringList &texts)
+void Embedding::lookupVectorCache(PendingDocument &doc)
 {
-    if (texts.isEmpty())
-        return {};
+    doc.vectors.assign(static_cast<size_t>(doc.chunks.size()) * EmbeddingDim, 0.0f);
+    doc.ready = QVector<bool>(doc.chunks.size(), false);
+    doc.hashes.clear();
+    if (!embeddingClient)
+        return;
 
-    int inputBatch = 15;
-    QVector<QVector<float>> vectors;
-    QStringList splitProcessText = texts;
-    int currentIndex = 0;
-    while (currentIndex < splitProcessText.size()) {
-        QStringList subList = splitProcessText.mid(currentIndex, inputBatch);
-        currentIndex += inputBatch;
-
-        QJsonObject emdObject = onHttpEmbedding(subList, apiData);
-        QJsonArray embeddingsArray = emdObject["data"].toArray();
-        for(auto embeddingObject : embeddingsArray) {
-            QJsonArray vectorArray = embeddingObject.toObject()["embedding"].toArray();
-            QVector<float> vectorTmp;
-            for (auto value : vectorArray) {
-                vectorTmp << static_cast<float>(value.toDouble());
+    //缓存键：模型名+文本的SHA1，换模型后不会误用旧向量
+    const QByteArray model = embeddingClient->modelName().toUtf8() + '\0';
+    QHash<QString, QVector<int>> positions;
+    for (int i = 0; i < doc.chunks.size(); i++) {
+        QString hash = QCryptographicHash::hash(model + doc.chunks.at(i).toUtf8(), QCryptographicHash::Sha1).toHex();
+        doc.hashes << hash;
+        positions[hash] << i;
+    }
+
+    QSqlDatabase reader = EmbedDBVendorIns->readerDatabase(dataBase);
+    const QStringList keys = positions.keys();
+    QVariantList hitHashes;
+    for (int pos = 0; pos < keys.size(); pos += EmbedDBVendor::kMaxBindValues) {
+        QVariantList hashes;
+        for (const QString &key : keys.mid(pos, EmbedDBVendor::kMaxBindValues))
+            hashes << key;
+
+        QString query = "SELECT hash, vector FROM " + QString(kEmbeddingDBVectorCacheTable)
+                + " WHERE hash IN (" + EmbedDBVendor::inPlaceholders(hashes) + ")";
+        QList<QVariantList> result;
+        EmbedDBVendorIns->executePreparedQuery(&reader, query, hashes, result);
+
+        for (const QVariantList &res : result) {
+            if (res.size() < 2)
+                continue;
+
+            const QByteArray blob = res[1].toByteArray();
+            if (blob.size() != EmbeddingDim * static_cast<int>(sizeof(float)))
+                continue;
+
+            for (int idx : positions.value(res[0].toString())) {
+                memcpy(doc.vectors.data() + static_cast<size_t>(idx) * EmbeddingDim, blob.constData(), static_cast<size_t>(blob.size()));
+                doc.ready[idx] = true;
             }
-            vectors << vectorTmp;
+            hitHashes << res[0];
         }
     }
-    return vectors;
+
+    //命中的缓存刷新使用时间，淘汰时按该时间排序
+    if (hitHashes.isEmpty())
+        return;
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QMutexLocker lk(dbMtx);
+    for (int pos = 0; pos < hitHashes.size(); pos += EmbedDBVendor::kMaxBindValues) {
+        QVariantList values = hitHashes.mid(pos, EmbedDBVendor::kMaxBindValues);
+        QString update = "UPDATE " + QString(kEmbeddingDBVectorCacheTable) + " SET " + QString(kEmbeddingDBVectorCacheLastUsed)
+                + " = ? WHERE hash IN (" + EmbedDBVendor::inPlaceholders(values) + ")";
+        values.prepend(now);
+        QList<QVariantList> unused;
+        EmbedDBVendorIns->executePreparedQuery(dataBase, update, values, unused);
+    }
+}
+
+int Embedding::vectorCacheSize() const
+{
+    return ConfigManagerIns->value(VECTOR_INDEX_GROUP, VECTOR_INDEX_VECTOR_CACHE_SIZE, kVectorCacheSize).toInt();
+}
+
+void Embedding::trimVectorCache()
+{
+    const int size = vectorCacheSize();
+    if (size <= 0)
+        return;
+
+    //保留最近使用的size条
+    QString remove = "DELETE FROM " + QString(kEmbeddingDBVectorCacheTable) + " WHERE hash IN (SELECT hash FROM "
+            + QString(kEmbeddingDBVectorCacheTable) + " ORDER BY " + QString(kEmbeddingDBVectorCacheLastUsed)
+            + " DESC LIMIT -1 OFFSET ?)";
+    QList<QVariantList> unused;
+    QMutexLocker lk(dbMtx);
+    if (!EmbedDBVendorIns->executePreparedQuery(dataBase, remove, { size }, unused))
+        qWarning() << "Trim embedding cache failed.";
+}
+
+QJsonObject Embedding::diagnostics() const
+{
+    QJsonObject obj;
+    if (embeddingClient)
+        obj["client"] = embeddingClient->diagnostics();
+
+    QJsonObject cache;
+    cache["hits"] = cacheHits.load();
+    cache["misses"] = cacheMisses.load();
+    cache["capacity"] = vectorCacheSize();
+    obj["cache"] = cache;
+    return obj;
 }
 
 void Embedding::embeddingQuery(const QString &query, QVector<float> &queryVector)
@@ -210,29 +498,21 @@ void Embedding::embeddingQuery(const QString &query, QVector<float> &queryVector
      * 调用接口将query进行向量化，结果通过queryVector传递float指针
     */
 
-    QStringList queryTexts;
-    queryTexts << "为这个句子生成表示以用于检索相关文章:" + query;
-    QJsonObject emdObject;
-    emdObject = onHttpEmbedding(queryTexts, apiData);
-
-    //获取query
-    //local
-    QJsonArray embeddingsArray = emdObject["data"].toArray();
-    for(auto embeddingObject : embeddingsArray) {
-        QJsonArray vectorArray = embeddingObject.toObject()["embedding"].toArray();
-        for (auto value : vectorArray) {
-            queryVector << static_cast<float>(value.toDouble());
-        }
-    }
+    if (!embeddingClient)
+        return;
+
+    //重复的问题直接取缓存的向量
+    if (!embeddingClient->embedQuery("为这个句子生成表示以用于检索相关文章:" + query, queryVector))
+        queryVector.clear();
 }
 
-bool Embedding::batchInsertDataToDB(const QStringList &inserQuery)
+bool Embedding::batchInsertDataToDB(const QString &insertQuery, const QList<QVariantList> &bindColumns)
 {
-    if (inserQuery.isEmpty())
+    if (bindColumns.isEmpty() || bindColumns.first().isEmpty())
         return false;
 
     QMutexLocker lk(dbMtx);
-    bool ok = EmbedDBVendorIns->commitTransaction(dataBase, inserQuery);
+    bool ok = EmbedDBVendorIns->executeBatch(dataBase, insertQuery, bindColumns);
     return ok;
 }
 
@@ -241,15 +521,17 @@ int Embedding::getDBLastID()
     QList<QVariantList> result;
 
     {
-        QString query = "SELECT id FROM " + QString(kEmbeddingDBIndexSegTable) + " ORDER BY id DESC LIMIT 1";
+        // 两张表都参与，落盘段中已被合并删除的id也不会被重新分配
+        QString query = "SELECT MAX(id) FROM (SELECT MAX(id) AS id FROM " + QString(kEmbeddingDBIndexSegTable)
+                + " UNION ALL SELECT MAX(id) AS id FROM " + QString(kEmbeddingDBMetaDataTable) + ")";
         QMutexLocker lk(dbMtx);
         EmbedDBVendorIns->executeQuery(dataBase, query, result);
     }
 
-    if (result.isEmpty())
+    if (result.isEmpty() || result[0].isEmpty())
         return 0;
 
-    if (!result[0][0].isValid())
+    if (!result[0][0].isValid() || result[0][0].isNull())
         return 0;
 
     return result[0][0].toInt() + 1;
@@ -259,25 +541,89 @@ void Embedding::createEmbedDataTable()
 {
     qInfo() << "create DB table *****";
 
-    QString createTable1SQL = "CREATE TABLE IF NOT EXISTS " + QString(kEmbeddingDBMetaDataTable) + " (id INTEGER PRIMARY KEY, source TEXT, content TEXT)";
+    QString createTable1SQL = "CREATE TABLE IF NOT EXISTS " + QString(kEmbeddingDBMetaDataTable)
+            + " (id INTEGER PRIMARY KEY, source TEXT, content TEXT, " + QString(kEmbeddingDBMetaDataTableStartIndex)
+            + " INTEGER DEFAULT -1, " + QString(kEmbeddingDBMetaDataTableLength) + " INTEGER DEFAULT 0)";
     QString createTable2SQL = "CREATE TABLE IF NOT EXISTS " + QString(kEmbeddingDBIndexSegTable) + " (id INTEGER PRIMARY KEY, deleteBit INTEGER, content TEXT)";
+    QString createTable3SQL = "CREATE TABLE IF NOT EXISTS " + QString(kEmbeddingDBVectorCacheTable) + " (hash TEXT PRIMARY KEY, vector BLOB, "
+            + QString(kEmbeddingDBVectorCacheLastUsed) + " INTEGER DEFAULT 0)";
+    QString createIndexSQL = "CREATE INDEX IF NOT EXISTS idx_" + QString(kEmbeddingDBMetaDataTable) + "_source ON "
+            + QString(kEmbeddingDBMetaDataTable) + " (source)";
+    QString createTable4SQL = "CREATE TABLE IF NOT EXISTS " + QString(kEmbeddingDBDeferredTable)
+            + " (id INTEGER PRIMARY KEY AUTOINCREMENT, source TEXT, content TEXT, " + QString(kEmbeddingDBMetaDataTableStartIndex)
+            + " INTEGER, " + QString(kEmbeddingDBMetaDataTableLength) + " INTEGER)";
+    QString createIndex2SQL = "CREATE INDEX IF NOT EXISTS idx_" + QString(kEmbeddingDBDeferredTable) + "_source ON "
+            + QString(kEmbeddingDBDeferredTable) + " (source)";
 
     QMutexLocker lk(dbMtx);
     EmbedDBVendorIns->executeQuery(dataBase, createTable1SQL);
     EmbedDBVendorIns->executeQuery(dataBase, createTable2SQL);
+    EmbedDBVendorIns->executeQuery(dataBase, createTable3SQL);
+    EmbedDBVendorIns->executeQuery(dataBase, createIndexSQL);
+    EmbedDBVendorIns->executeQuery(dataBase, createTable4SQL);
+    EmbedDBVendorIns->executeQuery(dataBase, createIndex2SQL);
+
+    // 旧版本建的表补充位置列
+    if (!hasOffsetColumns(dataBase)) {
+        for (const QString &column : { QString(kEmbeddingDBMetaDataTableStartIndex), QString(kEmbeddingDBMetaDataTableLength) }) {
+            QString alter = "ALTER TABLE " + QString(kEmbeddingDBMetaDataTable) + " ADD COLUMN " + column
+                    + (column == kEmbeddingDBMetaDataTableStartIndex ? " INTEGER DEFAULT -1" : " INTEGER DEFAULT 0");
+            EmbedDBVendorIns->executeQuery(dataBase, alter);
+        }
+        offsetColumns = -1;
+    }
+
+    // 旧版本建的向量缓存表补充使用时间列，原有条目最先淘汰
+    QList<QVariantList> cacheColumns;
+    EmbedDBVendorIns->executeQuery(dataBase, "PRAGMA table_info(" + QString(kEmbeddingDBVectorCacheTable) + ")", cacheColumns);
+    bool hasLastUsed = false;
+    for (const QVariantList &res : cacheColumns)
+        hasLastUsed = hasLastUsed || (res.size() >= 2 && res[1].toString() == kEmbeddingDBVectorCacheLastUsed);
+    if (!hasLastUsed) {
+        EmbedDBVendorIns->executeQuery(dataBase, "ALTER TABLE " + QString(kEmbeddingDBVectorCacheTable) + " ADD COLUMN "
+                                               + QString(kEmbeddingDBVectorCacheLastUsed) + " INTEGER DEFAULT 0");
+    }
+    EmbedDBVendorIns->executeQuery(dataBase, "CREATE INDEX IF NOT EXISTS idx_" + QString(kEmbeddingDBVectorCacheTable) + "_"
+                                           + QString(kEmbeddingDBVectorCacheLastUsed) + " ON " + QString(kEmbeddingDBVectorCacheTable)
+                                           + " (" + QString(kEmbeddingDBVectorCacheLastUsed) + ")");
     return ;
 }
 
+bool Embedding::hasOffsetColumns(QSqlDatabase *db)
+{
+    int state = offsetColumns.loadAcquire();
+    if (state >= 0)
+        return state == 1;
+
+    QList<QVariantList> result;
+    EmbedDBVendorIns->executeQuery(db, "PRAGMA table_info(" + QString(kEmbeddingDBMetaDataTable) + ")", result);
+
+    // PRAGMA table_info的第二列为列名
+    int found = 0;
+    for (const QVariantList &res : result) {
+        if (res.size() < 2)
+            continue;
+        const QString name = res[1].toString();
+        if (name == kEmbeddingDBMetaDataTableStartIndex || name == kEmbeddingDBMetaDataTableLength)
+            found++;
+    }
+
+    // 表还不存在时不缓存结果
+    if (!result.isEmpty())
+        offsetColumns.storeRelease(found == 2 ? 1 : 0);
+    return found == 2;
+}
+
 bool Embedding::isDupDocument(const QString &docFilePath)
 {
     QList<QVariantList> result;
 
     QString query = "SELECT CASE WHEN EXISTS (SELECT 1 FROM " + QString(kEmbeddingDBMetaDataTable)
-            + " WHERE source = '" + docFilePath + "') THEN 1 ELSE 0 END";
+            + " WHERE source = ?) THEN 1 ELSE 0 END";
 
     {
         QMutexLocker lk(dbMtx);
-        EmbedDBVendorIns->executeQuery(dataBase, query, result);
+        EmbedDBVendorIns->executePreparedQuery(dataBase, query, { docFilePath }, result);
     }
 
     if (result.isEmpty())
@@ -287,82 +633,56 @@ bool Embedding::isDupDocument(const QString &docFilePath)
     return result[0][0].toBool();
 }
 
-void Embedding::embeddingClear()
-{
-    embedDataCache.clear();
-    embedVectorCache.clear();
-}
-
-QMap<faiss::idx_t, QVector<float> > Embedding::getEmbedVectorCache()
-{
-    QMutexLocker lk(&embeddingMutex);
-    return embedVectorCache;
-}
-
-QMap<faiss::idx_t, QPair<QString, QString>> Embedding::getEmbedDataCache()
+QSet<QString> Embedding::existingDocuments(const QStringList &sources)
 {
-    QMutexLocker lk(&embeddingMutex);
-    return embedDataCache;
-}
-
-QStringList Embedding::textsSpliter(QString &texts)
-{
-    QStringList chunks;
-    QStringList splitTexts;
-
-    QRegularExpression regexSplit("[\n，；。,.]");
-    QRegularExpression regexInvalidChar("[\\s\u200B]+");
-    texts.replace(regexInvalidChar, " ");
-    texts.replace("'", "\""); //SQL语句有单引号会报错
-
-    splitTexts = texts.split(regexSplit, QString::SplitBehavior::SkipEmptyParts);
-
-    QString over = "";
-    for (auto text : splitTexts) {
-        text = over + text;
-        over = "";
-
-        if (text.length() > kMaxChunksSize) {
-            textsSplitSize(text, chunks, over);
-        } else if (text.length() > kMinChunksSize && text.length() < kMaxChunksSize) {
-            chunks << text;
-        } else {
-            over = text;
+    //已在缓存或已落盘的来源，落盘部分按批一次查询
+    QSet<QString> exists;
+    QVariantList pending;
+    {
+        QMutexLocker lk(&embeddingMutex);
+        for (const QString &source : sources) {
+            if (sourceIds.contains(source))
+                exists.insert(source);
+            else
+                pending << source;
         }
     }
 
-    if (over.length() > kMinChunksSize)
-        chunks << over;
-    else {
-        if (chunks.isEmpty())
-            chunks << over;
-        else
-            chunks.last() += over;
+    QSqlDatabase reader = EmbedDBVendorIns->readerDatabase(dataBase);
+    for (int pos = 0; pos < pending.size(); pos += EmbedDBVendor::kMaxBindValues) {
+        QVariantList values = pending.mid(pos, EmbedDBVendor::kMaxBindValues);
+        QString query = "SELECT DISTINCT source FROM " + QString(kEmbeddingDBMetaDataTable)
+                + " WHERE source IN (" + EmbedDBVendor::inPlaceholders(values) + ")";
+        QList<QVariantList> result;
+        EmbedDBVendorIns->executePreparedQuery(&reader, query, values, result);
+        for (const QVariantList &res : result) {
+            if (!res.isEmpty() && res[0].isValid())
+                exists.insert(res[0].toString());
+        }
     }
 
-    return chunks;
+    return exists;
 }
 
-void Embedding::textsSplitSize(const QString &text, QStringList &splits, QString &over, int pos)
+QString Embedding::documentSource(const QString &docFilePath, bool saveAs)
 {
-    if (pos >= text.length()) {
-        return;
-    }
-
-    QString part = text.mid(pos, kMaxChunksSize);
+    // 另存的文档以副本路径作为来源
+    return saveAs ? saveAsDocPath(docFilePath) : docFilePath;
+}
 
-    if (part.length() < kMaxChunksSize) {
-        over += part;
-        return;
-    }
-    splits << part;
-    textsSplitSize(text, splits, over, pos + kMaxChunksSize);
+void Embedding::embeddingClear()
+{
+    QMutexLocker lk(&embeddingMutex);
+    embedDataCache.clear();
+    chunkOffsets.clear();
+    sourceIds.clear();
+    vectorStore.clear();
 }
 
-QPair<QString, QString> Embedding::getDataCacheFromID(const faiss::idx_t &id)
+QMap<faiss::idx_t, QPair<QString, QString>> Embedding::getEmbedDataCache()
 {
     QMutexLocker lk(&embeddingMutex);
-    return QPair<QString, QString>(embedDataCache[id].first, embedDataCache[id].second);
+    return embedDataCache;
 }
 
 QString Embedding::saveAsDocPath(const QString &doc)
@@ -379,188 +699,180 @@ QString Embedding::saveAsDocPath(const QString &doc)
     return docDirStr + QDir::separator() + QFileInfo(doc).fileName();
 }
 
-QString Embedding::loadTextsFromSearch(int topK, const QMap<float, faiss::idx_t> &cacheSearchRes, const QMap<float, faiss::idx_t> &dumpSearchRes)
+QString Embedding::loadTextsFromSearch(int topK, const VectorSearchResult &searchResult, int snippetLength,
+                                       double *fetchTime, double *buildTime)
 {
-    QJsonObject resultObj;
-    resultObj["version"] = SEARCH_RESULT_VERSION;
-    QJsonArray resultArray;
-
-    if (appID == kSystemAssistantKey) {
-        for (auto dumpIt : dumpSearchRes.keys()) {
-            faiss::idx_t id = dumpSearchRes.value(dumpIt);
-            QList<QVariantList> result;
-
-            QString query = "SELECT * FROM " + QString(kEmbeddingDBMetaDataTable) + " WHERE id = " + QString::number(id);
-            {
-                QMutexLocker lk(dbMtx);
-                EmbedDBVendorIns->executeQuery(dataBase, query, result);
-            }
-
-            if (result.isEmpty()) {
-                return {};
-            }
-
-            QVariantList &res = result[0];
-            if (!res[1].isValid() || !res[2].isValid())
+    QElapsedTimer timer;
+    timer.start();
+
+    struct Hit {
+        QString source;
+        QString content;
+        qint64 start = -1;
+        qint64 length = 0;
+    };
+
+    //先查缓存，不在缓存中的已落盘
+    QHash<faiss::idx_t, Hit> texts;
+    QVariantList dumpIDs;
+    {
+        QMutexLocker lk(&embeddingMutex);
+        for (const QPair<float, faiss::idx_t> &hit : searchResult) {
+            auto it = embedDataCache.constFind(hit.second);
+            if (it == embedDataCache.constEnd()) {
+                dumpIDs << static_cast<qlonglong>(hit.second);
                 continue;
+            }
 
-            QString source = res[1].toString();
-            QString content = res[2].toString();
-            QJsonObject obj;
-            obj[kEmbeddingDBMetaDataTableSource] = source;
-            obj[kEmbeddingDBMetaDataTableContent] = content;
-            obj[kSearchResultDistance] = static_cast<double>(dumpIt);
-            resultArray.append(obj);
+            Hit text;
+            text.source = it->first;
+            text.content = snippetLength > 0 ? it->second.left(snippetLength) : it->second;
+            const QPair<qint64, qint64> offset = chunkOffsets.value(hit.second, qMakePair(qint64(-1), qint64(0)));
+            text.start = offset.first;
+            text.length = offset.second;
+            texts.insert(hit.second, text);
         }
-        resultObj["result"] = resultArray;
-        return QJsonDocument(resultObj).toJson(QJsonDocument::Compact);
     }
 
-    //TODO:重排序\合并两种结果；两个距离有序数组的合并
-    int sort = 1;
-    int i = 0;
-    int j = 0;
-
-    while (i < cacheSearchRes.size() && j < dumpSearchRes.size()) {
-        if (sort > topK)
-            break;
-
-        auto cacheIt = cacheSearchRes.begin() + i;
-        auto dumpIt = dumpSearchRes.begin() + j;
-        if (cacheIt.key() < dumpIt.key()) {
-            QString source = getDataCacheFromID(cacheIt.value()).first;
-            QString content = getDataCacheFromID(cacheIt.value()).second;
-            QJsonObject obj;
-            obj[kEmbeddingDBMetaDataTableSource] = source;
-            obj[kEmbeddingDBMetaDataTableContent] = content;
-            obj[kSearchResultDistance] = static_cast<double>(cacheIt.key());
-            resultArray.append(obj);
-            sort++;
-            i++;
-        } else {
-            faiss::idx_t id = dumpIt.value();
-            QList<QVariantList> result;
-
-            {
-                QString query = "SELECT * FROM " + QString(kEmbeddingDBMetaDataTable) + " WHERE id = " + QString::number(id);
-                QMutexLocker lk(dbMtx);
-                EmbedDBVendorIns->executeQuery(dataBase, query, result);
-            }
-
-            if (result.isEmpty()) {
-                j++;
-                continue;
-            }
+    //落盘的结果按批一次取回，每批不超过SQLite的参数上限；只读连接不与写入互斥
+    QSqlDatabase reader = EmbedDBVendorIns->readerDatabase(dataBase);
+    const bool withOffsets = !dumpIDs.isEmpty() && hasOffsetColumns(&reader);
+    // 只要摘要时由SQLite截取，不读出整段内容
+    const QString contentColumn = snippetLength > 0 ? QString("substr(content, 1, ?)") : QString("content");
+    const QString offsetSelect = withOffsets ? ", " + QString(kEmbeddingDBMetaDataTableStartIndex) + ", "
+                                                + QString(kEmbeddingDBMetaDataTableLength)
+                                              : QString();
+    for (int pos = 0; pos < dumpIDs.size(); pos += EmbedDBVendor::kMaxBindValues) {
+        QVariantList ids = dumpIDs.mid(pos, EmbedDBVendor::kMaxBindValues);
+        QString query = "SELECT id, source, " + contentColumn + offsetSelect + " FROM " + QString(kEmbeddingDBMetaDataTable)
+                + " WHERE id IN (" + EmbedDBVendor::inPlaceholders(ids) + ")";
+        // 摘要长度也作为参数绑定，不同长度共用一条语句
+        if (snippetLength > 0)
+            ids.prepend(snippetLength);
+        QList<QVariantList> result;
+        EmbedDBVendorIns->executePreparedQuery(&reader, query, ids, result);
 
-            QVariantList &res = result[0];
-            if (!res[1].isValid() || !res[2].isValid())
+        for (const QVariantList &res : result) {
+            if (res.size() < 3 || !res[0].isValid() || !res[1].isValid() || !res[2].isValid())
                 continue;
 
-            QString source = res[1].toString();
-            QString content = res[2].toString();
-            QJsonObject obj;
-            obj[kEmbeddingDBMetaDataTableSource] = source;
-            obj[kEmbeddingDBMetaDataTableContent] = content;
-            obj[kSearchResultDistance] = static_cast<double>(dumpIt.key());
-            resultArray.append(obj);
-            sort++;
-            j++;
+            Hit text;
+            text.source = res[1].toString();
+            text.content = res[2].toString();
+            if (withOffsets && res.size() >= 5) {
+                text.start = res[3].isNull() ? -1 : res[3].toLongLong();
+                text.length = res[4].toLongLong();
+            }
+            texts.insert(res[0].toLongLong(), text);
         }
     }
 
-    while (i < cacheSearchRes.size()) {
-        if (sort > topK)
-            break;
-
-        auto cacheIt = cacheSearchRes.begin() + i;
-        QString source = getDataCacheFromID(cacheIt.value()).first;
-        QString content = getDataCacheFromID(cacheIt.value()).second;
-        QJsonObject obj;
-        obj[kEmbeddingDBMetaDataTableSource] = source;
-        obj[kEmbeddingDBMetaDataTableContent] = content;
-        obj[kSearchResultDistance] = static_cast<double>(cacheIt.key());
-        resultArray.append(obj);
-        sort++;
-        i++;
-    }
+    if (fetchTime)
+        *fetchTime = timer.nsecsElapsed() / 1e6;
+    timer.restart();
 
-    while (j < dumpSearchRes.size()) {
-        if (sort > topK)
+    //按检索结果的顺序组装
+    QJsonObject resultObj;
+    resultObj["version"] = SEARCH_RESULT_VERSION;
+    QJsonArray resultArray;
+    for (const QPair<float, faiss::idx_t> &hit : searchResult) {
+        if (resultArray.size() >= topK)
             break;
 
-        auto dumpIt = dumpSearchRes.begin() + j;
-        faiss::idx_t id = dumpIt.value();
-        QList<QVariantList> result;
-        {
-            QString query = "SELECT * FROM " + QString(kEmbeddingDBMetaDataTable) + " WHERE id = " + QString::number(id);
-            QMutexLocker lk(dbMtx);
-            EmbedDBVendorIns->executeQuery(dataBase, query, result);
-        }
-        if (result.isEmpty()) {
-            j++;
-            continue;
-        }
-
-        QVariantList &res = result[0];
-        if (!res[1].isValid() || !res[2].isValid())
+        auto it = texts.constFind(hit.second);
+        if (it == texts.constEnd())
             continue;
 
-        QString source = res[1].toString();
-        QString content = res[2].toString();
         QJsonObject obj;
-        obj[kEmbeddingDBMetaDataTableSource] = source;
-        obj[kEmbeddingDBMetaDataTableContent] = content;
-        obj[kSearchResultDistance] = static_cast<double>(dumpIt.key());
+        obj[kEmbeddingDBMetaDataTableSource] = it->source;
+        obj[kEmbeddingDBMetaDataTableContent] = it->content;
+        obj[kEmbeddingDBMetaDataTableStartIndex] = it->start;
+        obj[kEmbeddingDBMetaDataTableLength] = it->length;
+        obj[kSearchResultDistance] = static_cast<double>(hit.first);
         resultArray.append(obj);
-        sort++;
-        j++;
     }
     resultObj["result"] = resultArray;
-    qDebug() << QString::fromUtf8(QJsonDocument(resultObj).toJson(QJsonDocument::Compact));
-    return QJsonDocument(resultObj).toJson(QJsonDocument::Compact);
+    QString json = QJsonDocument(resultObj).toJson(QJsonDocument::Compact);
+
+    if (buildTime)
+        *buildTime = timer.nsecsElapsed() / 1e6;
+
+    qDebug() << json;
+    return json;
 }
 
-void Embedding::deleteCacheIndex(const QStringList &files)
+QVector<faiss::idx_t> Embedding::deleteCacheIndex(const QStringList &files)
 {
     if (files.isEmpty())
-        return;
+        return {};
 
     QMutexLocker lk(&embeddingMutex);
-    for (auto id : embedDataCache.keys()) {
-        if (!files.contains(embedDataCache.value(id).first))
+    QSet<faiss::idx_t> removeIds;
+    for (const QString &file : files) {
+        auto it = sourceIds.find(file);
+        if (it == sourceIds.end())
             continue;
 
         //删除缓存文档数据、删除向量
-        embedDataCache.remove(id);
-        embedVectorCache.remove(id);
+        for (faiss::idx_t id : *it) {
+            embedDataCache.remove(id);
+            chunkOffsets.remove(id);
+            removeIds.insert(id);
+        }
+        sourceIds.erase(it);
     }
+    vectorStore.remove(removeIds);
+    return removeIds.values().toVector();
 }
 
-bool Embedding::doIndexDump(faiss::idx_t startID, faiss::idx_t endID)
+bool Embedding::doIndexDump(faiss::idx_t endID)
 {
     QMutexLocker lk(&embeddingMutex);
-    //插入源信息
-    QStringList insertSqlstrs;
-    for (faiss::idx_t id = startID; id <= endID; id++) {
-        if (!embedDataCache.contains(id))
-            continue;
-
-        QString queryStr = "INSERT INTO embedding_metadata (id, source, content) VALUES ("
-                + QString::number(id) + ", '" + embedDataCache.value(id).first + "', " + "'" + embedDataCache.value(id).second + "')";
-        insertSqlstrs << queryStr;
-
-        embedDataCache.remove(id);
-        embedVectorCache.remove(id);
+    //向量已写入段文件(id不大于endID)的文本块插入源信息，内容按原文绑定
+    QVariantList ids;
+    QVariantList sources;
+    QVariantList contents;
+    QVariantList starts;
+    QVariantList lengths;
+    for (auto it = embedDataCache.constBegin(); it != embedDataCache.constEnd() && it.key() <= endID; ++it) {
+        const QPair<qint64, qint64> offset = chunkOffsets.value(it.key(), qMakePair(qint64(-1), qint64(0)));
+        ids << static_cast<qlonglong>(it.key());
+        sources << it->first;
+        contents << it->second;
+        starts << offset.first;
+        lengths << offset.second;
     }
 
-    if (insertSqlstrs.isEmpty())
+    if (ids.isEmpty())
         return false;
 
-    if (!batchInsertDataToDB(insertSqlstrs)) {
+    // 写入失败时缓存保留，仍可检索，下次落盘重试
+    QString insert = "INSERT INTO " + QString(kEmbeddingDBMetaDataTable) + " (id, source, content, "
+            + QString(kEmbeddingDBMetaDataTableStartIndex) + ", " + QString(kEmbeddingDBMetaDataTableLength)
+            + ") VALUES (?, ?, ?, ?, ?)";
+    if (!batchInsertDataToDB(insert, { ids, sources, contents, starts, lengths })) {
         qWarning() << "Insert DB failed.";
         return false;
     }
 
+    QSet<faiss::idx_t> removeIds;
+    for (int i = 0; i < ids.size(); ++i) {
+        const faiss::idx_t id = ids.at(i).toLongLong();
+        auto srcIt = sourceIds.find(sources.at(i).toString());
+        if (srcIt != sourceIds.end()) {
+            srcIt->removeOne(id);
+            if (srcIt->isEmpty())
+                sourceIds.erase(srcIt);
+        }
+
+        embedDataCache.remove(id);
+        chunkOffsets.remove(id);
+        removeIds.insert(id);
+    }
+    vectorStore.remove(removeIds);
+    lk.unlock();
+
+    trimVectorCache();
     return true;
 }
 
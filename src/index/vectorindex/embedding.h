@@ -13,10 +13,15 @@
 #include <QStandardPaths>
 #include <QSqlDatabase>
 #include <QMutex>
+#include <QAtomicInteger>
 
-#include <faiss/Index.h>
+#include "vectorindex.h"
+#include "vectorstore.h"
+#include "textchunker.h"
+#include "../global_define.h"
+#include "modelhub/embeddingclient.h"
 
-typedef QJsonObject (*embeddingApi)(const QStringList &texts, void *user);
+#include <faiss/Index.h>
 
 class Embedding : public QObject
 {
@@ -24,24 +29,52 @@ class Embedding : public QObject
 public:
     explicit Embedding(QSqlDatabase *db, QMutex *mtx, const QString &appID, QObject *parent = nullptr);
 
+    //已提交向量化、尚未取回结果的文档
+    struct PendingDocument {
+        QString source;
+        QStringList chunks;
+        QVector<QPair<qint64, qint64>> offsets;   // 各块在正文中的<起始位置, 长度>
+        QStringList deferredChunks;            // 超出块数上限、留待空闲时补建的块
+        QVector<QPair<qint64, qint64>> deferredOffsets;
+        QStringList hashes;                    // 文本块的缓存键
+        std::vector<float> vectors;            // 各块向量连续存放
+        QVector<bool> ready;                   // 对应的向量是否已取得
+        QVector<int> misses;                   // 未命中的块在chunks中的位置
+        QList<EmbeddingClient::Batch> batches;
+    };
+
     bool embeddingDocument(const QString &docFilePath);
     bool embeddingDocumentSaveAs(const QString &docFilePath);
+    // 解析、分块并提交向量化请求，不等待结果
+    bool submitDocument(const QString &docFilePath, bool saveAs, PendingDocument &doc, bool checkDup = true);
+    // 等待向量化结果并写入缓存
+    bool finishDocument(PendingDocument &doc);
     QVector<QVector<float>> embeddingTexts(const QStringList &texts);
+    // 补建最多limit个待补建的块，返回处理的块数，失败返回-1
+    int embeddingDeferredChunks(int limit);
+    void deleteDeferredChunks(const QStringList &files);
     void embeddingQuery(const QString &query, QVector<float> &queryVector);
 
     //DB operate
-    bool batchInsertDataToDB(const QStringList &inserQuery);
+    bool batchInsertDataToDB(const QString &insertQuery, const QList<QVariantList> &bindColumns);
     int getDBLastID();
     void createEmbedDataTable();
     bool isDupDocument(const QString &docFilePath);
+    // 批量检查，返回已建过索引的来源
+    QSet<QString> existingDocuments(const QStringList &sources);
+    QString documentSource(const QString &docFilePath, bool saveAs);
 
     void embeddingClear();
 
-    QMap<faiss::idx_t, QVector<float>> getEmbedVectorCache();
+    // 仅在索引工作线程中访问
+    inline const VectorStore &getVectorStore() const { return vectorStore; }
     QMap<faiss::idx_t, QPair<QString, QString>> getEmbedDataCache();
 
-    QString loadTextsFromSearch(int topK, const QMap<float, faiss::idx_t> &cacheSearchRes,
-                                    const QMap<float, faiss::idx_t> &dumpSearchRes);
+    QJsonObject diagnostics() const;
+
+    // snippetLength > 0 时只返回内容的前snippetLength个字符
+    QString loadTextsFromSearch(int topK, const VectorSearchResult &searchResult, int snippetLength = 0,
+                                double *fetchTime = nullptr, double *buildTime = nullptr);
 
     inline static QString workerDir()
     {
@@ -50,32 +83,51 @@ public:
         return workerDir;
     }
 
-    inline void setEmbeddingApi(embeddingApi api, void *user) {
-        onHttpEmbedding = api;
-        apiData = user;
+    inline void setEmbeddingClient(EmbeddingClient *client) {
+        embeddingClient = client;
     }
 
-    void deleteCacheIndex(const QStringList &files);
-    bool doIndexDump(faiss::idx_t startID, faiss::idx_t endID);
+    // 返回被删除的缓存id
+    QVector<faiss::idx_t> deleteCacheIndex(const QStringList &files);
+    bool doIndexDump(faiss::idx_t endID);
     bool doSaveAsDoc(const QString &file);
     bool doDeleteSaveAsDoc(const QStringList &files);
 private:
-    QStringList textsSpliter(QString &texts);
-    void textsSplitSize(const QString &text, QStringList &splits, QString &over, int pos = 0);
-    QPair<QString, QString> getDataCacheFromID(const faiss::idx_t &id);
+    //单个文档建索引的块数策略
+    struct ChunkPolicy {
+        int maxChunks = kMaxDocumentChunks;   // <= 0 不限制
+        TextChunker::Sampling sampling = TextChunker::Head;
+        bool deferRemaining = true;
+    };
+    ChunkPolicy chunkPolicy() const;
+    void saveDeferredChunks(const PendingDocument &doc);
+
     QString saveAsDocPath(const QString &doc);
+    void submitChunks(PendingDocument &doc);
+    bool collectVectors(PendingDocument &doc);
+    bool hasOffsetColumns(QSqlDatabase *db);
+    void lookupVectorCache(PendingDocument &doc);
+    int vectorCacheSize() const;
+    void trimVectorCache();
 
-    embeddingApi onHttpEmbedding = nullptr;
-    void *apiData = nullptr;
+    EmbeddingClient *embeddingClient = nullptr;
 
     QMap<faiss::idx_t, QPair<QString, QString>> embedDataCache;
-    QMap<faiss::idx_t, QVector<float>> embedVectorCache;
+    QHash<QString, QVector<faiss::idx_t>> sourceIds;   // 来源 -> 缓存中的文本块id
+    QHash<faiss::idx_t, QPair<qint64, qint64>> chunkOffsets;
+    VectorStore vectorStore;
+    faiss::idx_t nextID = -1;
 
     QSqlDatabase *dataBase = nullptr;
     QMutex *dbMtx = nullptr;
 
     QMutex embeddingMutex;
 
+    QAtomicInt offsetColumns { -1 };   // 元数据表是否有位置列，-1为未检查
+    QAtomicInt deferredState { -1 };   // 是否有待补建的块，-1为未检查
+    QAtomicInteger<qint64> cacheHits = 0;
+    QAtomicInteger<qint64> cacheMisses = 0;
+
     QString appID;
 };
 
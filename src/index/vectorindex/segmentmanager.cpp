@@ -0,0 +1,335 @@
+// SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "segmentmanager.h"
+#include "../global_define.h"
+
+#include <QDir>
+#include <QSet>
+#include <QFile>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QRegularExpression>
+#include <QDebug>
+
+#include <faiss/index_io.h>
+#include <faiss/impl/FaissException.h>
+
+#include <algorithm>
+#include <cstring>
+
+// 段的删除文件：<段文件名>.del，按升序存放已删除的id(int64)
+static constexpr char kDeletedSuffix[] { ".del" };
+// 合并记录：<新段文件名>.compact，每行一个被合并的旧段名，替换完成后删除
+static constexpr char kReplaceSuffix[] { ".compact" };
+// 新段写入时的临时文件
+static constexpr char kTmpSuffix[] { ".tmp" };
+
+SegmentManager::DeletedIds::DeletedIds(std::vector<faiss::idx_t> sortedIds)
+    : ids(std::move(sortedIds))
+    , batch(ids.size(), ids.data())
+    , selector(&batch)
+{
+}
+
+SegmentManager::SegmentManager(const QString &indexDir)
+    : dirPath(indexDir)
+{
+}
+
+void SegmentManager::setLegacyDeletedLoader(const LegacyDeletedLoader &loader)
+{
+    QMutexLocker lk(&mtx);
+    legacyLoader = loader;
+}
+
+void SegmentManager::initDeleted(const QString &name)
+{
+    writeDeleted(name, {});
+}
+
+void SegmentManager::markDeleted(const QHash<QString, QVector<faiss::idx_t>> &idsBySegment)
+{
+    QMutexLocker lk(&mtx);
+    for (auto it = idsBySegment.constBegin(); it != idsBySegment.constEnd(); ++it) {
+        if (it.value().isEmpty())
+            continue;
+
+        SegmentPtr seg = loaded.value(it.key());
+        QSharedPointer<const DeletedIds> old = seg ? seg->deleted : readDeleted(it.key());
+
+        std::vector<faiss::idx_t> ids = old ? old->ids : std::vector<faiss::idx_t>();
+        ids.insert(ids.end(), it.value().begin(), it.value().end());
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+        if (!writeDeleted(it.key(), ids))
+            continue;
+
+        // 检索可能正持有旧的段，复制一份再替换
+        if (seg) {
+            SegmentPtr updated(new Segment(*seg));
+            updated->deleted.reset(new DeletedIds(std::move(ids)));
+            loaded.insert(it.key(), updated);
+        }
+    }
+}
+
+QList<SegmentManager::SegmentPtr> SegmentManager::segments(qint64 *loadTime)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QDir indexDir(dirPath);
+    QFileInfoList fileList = indexDir.entryInfoList(QDir::Files, QDir::Name);
+
+    QList<SegmentPtr> result;
+    QSet<QString> exists;
+
+    QMutexLocker lk(&mtx);
+    for (const QFileInfo &fileInfo : fileList) {
+        QString type;
+        const QString name = fileInfo.fileName();
+        if (!isSegmentFile(name, &type))
+            continue;
+
+        exists.insert(name);
+        const qint64 lastModified = fileInfo.lastModified().toMSecsSinceEpoch();
+        SegmentPtr seg = loaded.value(name);
+        if (seg && seg->lastModified == lastModified && seg->fileSize == fileInfo.size()) {
+            result << seg;
+            continue;
+        }
+
+        // 段文件新增或在磁盘上被改写，重新加载
+        faiss::Index *index = loadIndex(fileInfo.absoluteFilePath(), type);
+        if (!index) {
+            loaded.remove(name);
+            continue;
+        }
+
+        seg.reset(new Segment);
+        seg->name = name;
+        seg->type = type;
+        seg->lastModified = lastModified;
+        seg->fileSize = fileInfo.size();
+        seg->index.reset(index);
+        seg->deleted = readDeleted(name);
+        loaded.insert(name, seg);
+        result << seg;
+    }
+
+    // 已被删除的段文件
+    for (auto it = loaded.begin(); it != loaded.end();) {
+        if (!exists.contains(it.key()))
+            it = loaded.erase(it);
+        else
+            ++it;
+    }
+
+    if (loadTime)
+        *loadTime = timer.elapsed();
+    return result;
+}
+
+void SegmentManager::invalidate(const QString &name)
+{
+    QMutexLocker lk(&mtx);
+    loaded.remove(name);
+}
+
+bool SegmentManager::beginReplace(const QStringList &oldNames, const QString &newName)
+{
+    QMutexLocker lk(&mtx);
+
+    // 合并期间旧段上新增的删除带到新段，新段已有的删除保留，合并时已丢弃的id多记无妨
+    std::vector<faiss::idx_t> deleted;
+    QStringList names = oldNames;
+    if (QFile::exists(deletedPath(newName)))
+        names << newName;
+    for (const QString &name : names) {
+        SegmentPtr seg = loaded.value(name);
+        QSharedPointer<const DeletedIds> ids = seg ? seg->deleted : readDeleted(name);
+        if (ids)
+            deleted.insert(deleted.end(), ids->ids.begin(), ids->ids.end());
+    }
+    std::sort(deleted.begin(), deleted.end());
+    deleted.erase(std::unique(deleted.begin(), deleted.end()), deleted.end());
+    if (!writeDeleted(newName, deleted))
+        return false;
+
+    QSaveFile file(replacePath(newName));
+    if (!file.open(QIODevice::WriteOnly) || file.write(oldNames.join('\n').toUtf8()) < 0 || !file.commit()) {
+        qWarning() << "can not write replace record" << file.fileName();
+        QFile::remove(deletedPath(newName));
+        return false;
+    }
+    return true;
+}
+
+bool SegmentManager::replace(const QStringList &oldNames, const QString &tmpPath, const QString &newName)
+{
+    const QString newPath = QDir(dirPath).filePath(newName);
+
+    // 持锁完成重命名与删除，检索不会同时看到新旧两份数据
+    QMutexLocker lk(&mtx);
+    if (!QFile::rename(tmpPath, newPath)) {
+        // 表已指向新段，保留合并记录，下次启动时重试
+        qWarning() << "can not rename index segment" << tmpPath << "to" << newPath;
+        return false;
+    }
+    loaded.remove(newName);
+
+    removeSegments(oldNames);
+    QFile::remove(replacePath(newName));
+    return true;
+}
+
+void SegmentManager::abortReplace(const QString &newName)
+{
+    QMutexLocker lk(&mtx);
+    QFile::remove(deletedPath(newName));
+    QFile::remove(replacePath(newName));
+}
+
+void SegmentManager::recover(const ReplaceChecker &checker)
+{
+    QDir indexDir(dirPath);
+    const QStringList records = indexDir.entryList({ QString("*") + kReplaceSuffix }, QDir::Files);
+    for (const QString &record : records) {
+        const QString newName = record.left(record.size() - static_cast<int>(strlen(kReplaceSuffix)));
+        bool committed = false;
+        if (!isSegmentFile(newName) || !checker(newName, &committed))
+            continue;
+
+        QFile file(indexDir.filePath(record));
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+        const QStringList oldNames = QString::fromUtf8(file.readAll()).split('\n', QString::SkipEmptyParts);
+        file.close();
+
+        const QString tmpPath = indexDir.filePath(newName + kTmpSuffix);
+        if (committed) {
+            qInfo() << "finish interrupted segment replace:" << oldNames << "to" << newName;
+            if (QFile::exists(tmpPath) && !replace(oldNames, tmpPath, newName))
+                continue;
+
+            QMutexLocker lk(&mtx);
+            removeSegments(oldNames);
+            QFile::remove(replacePath(newName));
+        } else {
+            qInfo() << "roll back interrupted segment replace:" << oldNames << "to" << newName;
+            QFile::remove(tmpPath);
+            abortReplace(newName);
+        }
+    }
+
+    // 写入中途退出留下的临时文件
+    for (const QString &tmp : indexDir.entryList({ QString("*.faiss") + kTmpSuffix }, QDir::Files)) {
+        const QString name = tmp.left(tmp.size() - static_cast<int>(strlen(kTmpSuffix)));
+        if (!QFile::exists(replacePath(name)))
+            QFile::remove(indexDir.filePath(tmp));
+    }
+}
+
+void SegmentManager::removeSegments(const QStringList &names)
+{
+    QDir indexDir(dirPath);
+    for (const QString &name : names) {
+        if (QFile::exists(indexDir.filePath(name)) && !QFile::remove(indexDir.filePath(name)))
+            qWarning() << "can not remove index segment" << name;
+        QFile::remove(deletedPath(name));
+        loaded.remove(name);
+    }
+}
+
+void SegmentManager::invalidateAll()
+{
+    QMutexLocker lk(&mtx);
+    loaded.clear();
+}
+
+bool SegmentManager::isSegmentFile(const QString &fileName, QString *type)
+{
+    static const QRegularExpression regex(QString("^(%0|%1|%2)_\\d+\\.faiss$")
+                                                  .arg(QString(kFaissFlatIndex))
+                                                  .arg(QString(kFaissIvfFlatIndex))
+                                                  .arg(QString(kFaissIvfPQIndex)));
+    QRegularExpressionMatch match = regex.match(fileName);
+    if (!match.hasMatch())
+        return false;
+
+    if (type)
+        *type = match.captured(1);
+    return true;
+}
+
+faiss::Index *SegmentManager::loadIndex(const QString &path, const QString &type)
+{
+    // faiss只支持对IVF的倒排表做mmap，Flat段仍需读入内存
+    int ioFlags = 0;
+    if (type != kFaissFlatIndex)
+        ioFlags = faiss::IO_FLAG_MMAP | faiss::IO_FLAG_READ_ONLY;
+
+    try {
+        return faiss::read_index(path.toStdString().c_str(), ioFlags);
+    } catch (faiss::FaissException &e) {
+        qWarning() << "load index segment failed:" << path << e.what();
+    }
+
+    return nullptr;
+}
+
+QString SegmentManager::deletedPath(const QString &name) const
+{
+    return QDir(dirPath).filePath(name + kDeletedSuffix);
+}
+
+QString SegmentManager::replacePath(const QString &name) const
+{
+    return QDir(dirPath).filePath(name + kReplaceSuffix);
+}
+
+QSharedPointer<const SegmentManager::DeletedIds> SegmentManager::readDeleted(const QString &name)
+{
+    std::vector<faiss::idx_t> ids;
+    QFile file(deletedPath(name));
+    if (file.open(QIODevice::ReadOnly)) {
+        const QByteArray data = file.readAll();
+        if (data.size() % static_cast<int>(sizeof(faiss::idx_t)) != 0)
+            qWarning() << "invalid deleted ids file" << file.fileName();
+
+        ids.resize(static_cast<size_t>(data.size()) / sizeof(faiss::idx_t));
+        memcpy(ids.data(), data.constData(), ids.size() * sizeof(faiss::idx_t));
+    } else if (legacyLoader) {
+        // 首次加载旧版本的段，从数据库取回后写入删除文件
+        for (faiss::idx_t id : legacyLoader(name))
+            ids.push_back(id);
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        writeDeleted(name, ids);
+    }
+
+    if (ids.empty())
+        return {};
+    return QSharedPointer<const DeletedIds>(new DeletedIds(std::move(ids)));
+}
+
+bool SegmentManager::writeDeleted(const QString &name, const std::vector<faiss::idx_t> &ids)
+{
+    QSaveFile file(deletedPath(name));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "can not write deleted ids file" << file.fileName();
+        return false;
+    }
+
+    const qint64 bytes = static_cast<qint64>(ids.size() * sizeof(faiss::idx_t));
+    if (bytes > 0 && file.write(reinterpret_cast<const char *>(ids.data()), bytes) != bytes) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
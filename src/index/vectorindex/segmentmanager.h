@@ -0,0 +1,85 @@
+// SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef SEGMENTMANAGER_H
+#define SEGMENTMANAGER_H
+
+#include <QString>
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include <QStringList>
+#include <QMutex>
+#include <QSharedPointer>
+
+#include <faiss/Index.h>
+#include <faiss/impl/IDSelector.h>
+
+#include <functional>
+#include <vector>
+
+//落盘索引段(Flat_N.faiss等)的常驻管理，每个段只加载一次
+class SegmentManager
+{
+public:
+    // 段内已删除的id，创建后只读，可在多个检索线程间共享
+    struct DeletedIds {
+        explicit DeletedIds(std::vector<faiss::idx_t> sortedIds);
+        Q_DISABLE_COPY(DeletedIds)
+
+        std::vector<faiss::idx_t> ids;   // 升序
+        faiss::IDSelectorBatch batch;
+        faiss::IDSelectorNot selector;   // 检索时使用：排除已删除的id
+    };
+
+    struct Segment {
+        QString name;
+        QString type;
+        qint64 lastModified = 0;
+        qint64 fileSize = 0;
+        QSharedPointer<faiss::Index> index;
+        QSharedPointer<const DeletedIds> deleted;   // 为空表示没有删除
+    };
+    typedef QSharedPointer<Segment> SegmentPtr;
+    // 旧版本的段没有删除文件，由调用方从数据库取回已删除的id
+    typedef std::function<QVector<faiss::idx_t>(const QString &name)> LegacyDeletedLoader;
+    // 查询index_segment表是否已指向新段，查询失败时返回false
+    typedef std::function<bool(const QString &name, bool *committed)> ReplaceChecker;
+
+    explicit SegmentManager(const QString &indexDir);
+
+    void setLegacyDeletedLoader(const LegacyDeletedLoader &loader);
+    // 新写入的段没有删除
+    void initDeleted(const QString &name);
+    // 追加各段中被删除的id，并写入段的删除文件
+    void markDeleted(const QHash<QString, QVector<faiss::idx_t>> &idsBySegment);
+
+    // 返回当前目录下所有索引段，新增或变化的段文件会被(重新)加载
+    QList<SegmentPtr> segments(qint64 *loadTime = nullptr);
+    void invalidate(const QString &name);
+    // 合并段分三步：beginReplace写入新段的删除集合与合并记录，调用方切换index_segment表后
+    // 由replace用新段(临时文件)替换旧段；切换失败时abortReplace撤销。中途退出由recover完成或撤销
+    bool beginReplace(const QStringList &oldNames, const QString &newName);
+    bool replace(const QStringList &oldNames, const QString &tmpPath, const QString &newName);
+    void abortReplace(const QString &newName);
+    void recover(const ReplaceChecker &checker);
+    void invalidateAll();
+
+    static bool isSegmentFile(const QString &fileName, QString *type = nullptr);
+
+private:
+    faiss::Index *loadIndex(const QString &path, const QString &type);
+    QString deletedPath(const QString &name) const;
+    QString replacePath(const QString &name) const;
+    void removeSegments(const QStringList &names);
+    QSharedPointer<const DeletedIds> readDeleted(const QString &name);
+    bool writeDeleted(const QString &name, const std::vector<faiss::idx_t> &ids);
+
+    QString dirPath;
+    LegacyDeletedLoader legacyLoader;
+    QHash<QString, SegmentPtr> loaded;
+    QMutex mtx;
+};
+
+#endif // SEGMENTMANAGER_H
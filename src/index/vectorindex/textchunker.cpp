@@ -0,0 +1,257 @@
+// SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "textchunker.h"
+#include "../global_define.h"
+
+#include <algorithm>
+
+namespace {
+
+enum CharClass : quint8 {
+    Normal = 0,
+    Space,
+    Separator
+};
+
+// ASCII字符类别表，其余字符单独判断
+struct CharTable {
+    quint8 ascii[128] = {};
+    CharTable()
+    {
+        for (char c : { ' ', '\t', '\n', '\v', '\f', '\r' })
+            ascii[static_cast<int>(c)] = Space;
+        ascii[static_cast<int>(',')] = Separator;
+        ascii[static_cast<int>('.')] = Separator;
+    }
+};
+
+inline CharClass charClass(ushort c)
+{
+    static const CharTable table;
+    if (c < 128)
+        return static_cast<CharClass>(table.ascii[c]);
+
+    switch (c) {
+    case 0x200B:   // 零宽空格
+        return Space;
+    case 0xFF0C:   // ，
+    case 0xFF1B:   // ；
+    case 0x3002:   // 。
+        return Separator;
+    default:
+        return Normal;
+    }
+}
+
+// 不超过该长度且独占一行的文本视为标题
+static constexpr int kMaxHeadingLength = 40;
+
+// 块内有某行的首个非空白字符，且该行较短。短句合并后标题可能不在块的开头
+bool isHeading(const QString &text, const TextChunk &chunk)
+{
+    const int size = text.size();
+    const int end = qMin(chunk.start + chunk.length, size);
+
+    // 块起点与上一个换行之间只有空白时，起点所在行也算
+    int lineStart = chunk.start;
+    for (int i = chunk.start - 1; i >= 0 && text.at(i) != QLatin1Char('\n'); --i) {
+        if (charClass(text.at(i).unicode()) != Space) {
+            const int next = text.indexOf(QLatin1Char('\n'), chunk.start);
+            lineStart = next < 0 ? size : next + 1;
+            break;
+        }
+    }
+
+    while (lineStart < end) {
+        int begin = lineStart;
+        while (begin < end && text.at(begin) != QLatin1Char('\n') && charClass(text.at(begin).unicode()) == Space)
+            ++begin;
+
+        const int lineEnd = text.indexOf(QLatin1Char('\n'), begin);
+        const int lineLength = (lineEnd < 0 ? size : lineEnd) - begin;
+        if (begin < end && lineLength > 0 && lineLength <= kMaxHeadingLength)
+            return true;
+        if (lineEnd < 0)
+            break;
+        lineStart = lineEnd + 1;
+    }
+    return false;
+}
+
+// 从candidates中等间隔选取count个
+void pickStride(const QVector<int> &candidates, int count, QVector<int> &picked)
+{
+    const int total = candidates.size();
+    if (count >= total) {
+        picked << candidates;
+        return;
+    }
+
+    for (int k = 0; k < count; ++k)
+        picked << candidates.at(static_cast<int>(static_cast<qint64>(k) * total / count));
+}
+
+class ChunkBuilder
+{
+public:
+    explicit ChunkBuilder(int maxChunks)
+        : maxChunks(maxChunks)
+    {
+        buf.reserve(kMaxChunksSize + 1);
+    }
+
+    // 多切出一块后停止，保证第maxChunks块不会再被后续文本追加
+    inline bool full() const { return maxChunks >= 0 && chunks.size() > maxChunks; }
+
+    void append(QChar c, int offset)
+    {
+        if (buf.isEmpty())
+            bufStart = offset;
+        buf.append(c);
+        bufEnd = offset + 1;
+        pieceLength++;
+
+        // 句子超过最大长度时按最大长度切分；首块需超过最大长度，之后满最大长度即切
+        if (!slicing && buf.length() > kMaxChunksSize) {
+            emitChunk(buf.left(kMaxChunksSize), bufStart, offset - bufStart);
+            buf = buf.right(buf.length() - kMaxChunksSize);
+            bufStart = offset;
+            slicing = true;
+        } else if (slicing && buf.length() == kMaxChunksSize) {
+            emitChunk(buf, bufStart, bufEnd - bufStart);
+            buf.clear();
+        }
+    }
+
+    // 一句结束(遇到分隔符或文本结尾)
+    void endPiece()
+    {
+        if (pieceLength == 0)
+            return;
+
+        // 切分剩余部分留给下一句
+        if (!slicing && buf.length() > kMinChunksSize && buf.length() < kMaxChunksSize) {
+            emitChunk(buf, bufStart, bufEnd - bufStart);
+            buf.clear();
+        }
+
+        pieceLength = 0;
+        slicing = false;
+    }
+
+    QList<TextChunk> finish()
+    {
+        if (!full()) {
+            if (buf.length() > kMinChunksSize || chunks.isEmpty()) {
+                emitChunk(buf, buf.isEmpty() ? 0 : bufStart, buf.isEmpty() ? 0 : bufEnd - bufStart);
+            } else if (!buf.isEmpty()) {
+                TextChunk &last = chunks.last();
+                last.text += buf;
+                last.length = bufEnd - last.start;
+            }
+        }
+        buf.clear();
+
+        if (maxChunks >= 0 && chunks.size() > maxChunks)
+            chunks.erase(chunks.begin() + maxChunks, chunks.end());
+        return chunks;
+    }
+
+private:
+    void emitChunk(const QString &text, int start, int length)
+    {
+        TextChunk chunk;
+        chunk.text = text;
+        chunk.start = start;
+        chunk.length = length;
+        chunks << chunk;
+    }
+
+    QList<TextChunk> chunks;
+    QString buf;
+    int bufStart = 0;
+    int bufEnd = 0;
+    int pieceLength = 0;
+    bool slicing = false;
+    int maxChunks = -1;
+};
+
+}
+
+QList<TextChunk> TextChunker::split(const QString &text, int maxChunks)
+{
+    ChunkBuilder builder(maxChunks);
+    if (maxChunks == 0)
+        return {};
+
+    const QChar *data = text.constData();
+    const int size = text.size();
+    bool inSpace = false;
+    for (int i = 0; i < size && !builder.full(); ++i) {
+        switch (charClass(data[i].unicode())) {
+        case Space:
+            // 连续空白只保留一个空格
+            if (!inSpace)
+                builder.append(QLatin1Char(' '), i);
+            inSpace = true;
+            break;
+        case Separator:
+            inSpace = false;
+            builder.endPiece();
+            break;
+        default:
+            inSpace = false;
+            builder.append(data[i], i);
+            break;
+        }
+    }
+
+    builder.endPiece();
+    return builder.finish();
+}
+
+QVector<int> TextChunker::sample(const QString &text, const QList<TextChunk> &chunks, int count, Sampling sampling)
+{
+    const int total = chunks.size();
+    QVector<int> picked;
+    if (count <= 0)
+        return picked;
+
+    if (count >= total || sampling == Head) {
+        for (int i = 0; i < qMin(count, total); ++i)
+            picked << i;
+        return picked;
+    }
+
+    QVector<int> rest;
+    if (sampling == Headings) {
+        // 开头一块总是保留，标题超出名额时取前面的
+        picked << 0;
+        for (int i = 1; i < total; ++i) {
+            if (picked.size() < count && isHeading(text, chunks.at(i)))
+                picked << i;
+            else
+                rest << i;
+        }
+        pickStride(rest, count - picked.size(), picked);
+        std::sort(picked.begin(), picked.end());
+        return picked;
+    }
+
+    for (int i = 0; i < total; ++i)
+        rest << i;
+    pickStride(rest, count, picked);
+    return picked;
+}
+
+TextChunker::Sampling TextChunker::samplingFromString(const QString &name)
+{
+    const QString lower = name.trimmed().toLower();
+    if (lower == QLatin1String("stride"))
+        return Stride;
+    if (lower == QLatin1String("headings"))
+        return Headings;
+    return Head;
+}
@@ -0,0 +1,37 @@
+// SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef TEXTCHUNKER_H
+#define TEXTCHUNKER_H
+
+#include <QString>
+#include <QList>
+#include <QVector>
+
+struct TextChunk {
+    QString text;
+    int start = 0;    // 在文档中的起始位置(UTF-16)
+    int length = 0;   // 在文档中覆盖的长度(UTF-16)
+};
+
+// 单遍扫描的文本分块：空白折叠为一个空格，按标点断句，短句合并、长句按最大长度切分
+class TextChunker
+{
+public:
+    // 块数超出上限时优先建索引的块的选取方式
+    enum Sampling {
+        Head,       // 取前面的块
+        Stride,     // 全文等间隔选取
+        Headings    // 章节标题所在的块优先，其余等间隔补足
+    };
+
+    // maxChunks < 0 时不限制块数，达到上限后立即停止扫描
+    static QList<TextChunk> split(const QString &text, int maxChunks = -1);
+
+    // 从chunks中选取count个块，返回按文档顺序排列的下标
+    static QVector<int> sample(const QString &text, const QList<TextChunk> &chunks, int count, Sampling sampling);
+    static Sampling samplingFromString(const QString &name);
+};
+
+#endif // TEXTCHUNKER_H
@@ -5,6 +5,7 @@
 #include "vectorindex.h"
 #include "../global_define.h"
 #include "database/embeddatabase.h"
+#include "config/configmanager.h"
 
 #include <QList>
 #include <QFile>
@@ -18,7 +19,12 @@
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QEventLoop>
+#include <QElapsedTimer>
 
+#include <cmath>
+#include <numeric>
+
+#include <faiss/IndexIVF.h>
 #include <faiss/IndexIVFPQ.h>
 #include <faiss/index_io.h>
 #include <faiss/index_factory.h>
@@ -26,6 +32,7 @@
 #include <faiss/IndexShards.h>
 #include <faiss/IndexFlatCodes.h>
 #include <faiss/impl/IDSelector.h>
+#include <faiss/utils/Heap.h>
 
 VectorIndex::VectorIndex(QSqlDatabase *db, QMutex *mtx, const QString &appID, QObject *parent)
     :QObject (parent)
@@ -34,35 +41,48 @@ VectorIndex::VectorIndex(QSqlDatabase *db, QMutex *mtx, const QString &appID, QO
     , appID(appID)
 {
     dumpIndexIDRange = qMakePair(0, -1);
+    segmentManager = new SegmentManager(workerDir() + QDir::separator() + appID);
+    segmentManager->setLegacyDeletedLoader([this](const QString &segment) {
+        return loadLegacyDeleted(segment);
+    });
+    compactPool.setMaxThreadCount(1);
 }
 
-bool VectorIndex::updateIndex(int d, const QMap<faiss::idx_t, QVector<float>> &embedVectorCache)
+VectorIndex::~VectorIndex()
+{
+    compactPool.waitForDone();
+    delete segmentManager;
+    segmentManager = nullptr;
+}
+
+bool VectorIndex::updateIndex(int d, const VectorStore &store)
 {
     QMutexLocker lk(&vectorIndexMtx);
-    if (embedVectorCache.isEmpty())
+    if (store.isEmpty())
         return false;
 
     if (!cacheIndex) {
         faiss::Index *index = faiss::index_factory(d, kFaissFlatIndex);
-        cacheIndex = new faiss::IndexIDMap(index);
+        cacheIndex = new faiss::IndexIDMap2(index);
     }
 
-    faiss::idx_t oldNTotal = cacheIndex->ntotal + embedVectorCache.firstKey();
-    QVector<float> embeddingsTmp;
-    QVector<faiss::idx_t> idsTmp;
-
-    for (faiss::idx_t id = oldNTotal; id <= embedVectorCache.lastKey(); id++) {
-        embeddingsTmp += embedVectorCache.value(id);
-        idsTmp << id;
-    }
+    // 存储中id递增，只添加缓存索引与已落盘的最大id之后的新向量，直接使用存储的内存。
+    // 已落盘但元数据尚未写入的向量仍留在存储中，不再添加
+    faiss::idx_t oldNTotal = cacheIndex->ntotal;
+    const faiss::idx_t lastID = cacheIndex->id_map.empty() ? dumpedID : qMax(dumpedID, cacheIndex->id_map.back());
+    faiss::idx_t firstRow = store.upperBound(lastID);
+    faiss::idx_t count = store.size() - firstRow;
+    if (count <= 0)
+        return false;
 
-    qInfo() << "***" << idsTmp.size() << idsTmp;
-    cacheIndex->add_with_ids(idsTmp.size(), embeddingsTmp.data(), idsTmp.data());
+    cacheIndex->add_with_ids(count, store.vectors(firstRow), store.ids(firstRow));
     faiss::idx_t newNTotal = cacheIndex->ntotal;
 
     qInfo() << "old total" << oldNTotal;
     qInfo() << "new total" << newNTotal;
-    segmentIds += idsTmp;   //每个segment的索引所对应的IDs
+    segmentIds.reserve(segmentIds.size() + static_cast<int>(count));
+    for (faiss::idx_t row = firstRow; row < store.size(); row++)
+        segmentIds << *store.ids(row);   //每个segment的索引所对应的IDs
 
     dumpIndexIDRange = qMakePair(cacheIndex->id_map.front(), cacheIndex->id_map.back());
     lk.unlock();
@@ -89,82 +109,108 @@ bool VectorIndex::saveIndexToFile(const faiss::Index *index, const QString &inde
             return false;
         }
     }
-    QHash<QString, int> indexFilesNum = getIndexFilesNum();
-    QString indexName = indexType + "_" + QString::number(indexFilesNum.value(indexType)) + ".faiss";
+    QString indexName = indexType + "_" + QString::number(nextSegmentNumber(indexType)) + ".faiss";
     QString indexPath = indexDir.path() + QDir::separator() + indexName;
+    QString tmpPath = indexPath + ".tmp";
     qInfo() << "index file save to " + indexPath;
 
-    QStringList insertStrs;
-    for (faiss::idx_t id : segmentIds) {
-        QString insert = "INSERT INTO " + QString(kEmbeddingDBIndexSegTable)
-                + " (id, " + QString(kEmbeddingDBSegIndexTableBitSet)
-                + ", " + QString(kEmbeddingDBSegIndexIndexName) + ") " + "VALUES ("
-                + QString::number(id) + ", " + "0" + ", '" + indexName + "')";
-        insertStrs << insert;
+    // 先写段文件，成功后再写index_segment表；失败时待落盘的id保留，下次落盘重试
+    try {
+        faiss::write_index(index, tmpPath.toStdString().c_str());
+    } catch (faiss::FaissException &e) {
+        std::cerr << "Faiss error: " << e.what() << std::endl;
+        QFile::remove(tmpPath);
+        return false;
     }
 
-    {
-        //QString query = "SELECT id FROM " + QString(kEmbeddingDBMetaDataTable) + " ORDER BY id DESC LIMIT 1";
-        QMutexLocker lk(dbMtx);
-        EmbedDBVendorIns->commitTransaction(dataBase, insertStrs);
+    if (!QFile::rename(tmpPath, indexPath)) {
+        qWarning() << "can not rename index segment" << tmpPath << "to" << indexPath;
+        QFile::remove(tmpPath);
+        return false;
     }
 
-    segmentIds.clear();
+    if (!segmentIds.isEmpty()) {
+        QVariantList ids;
+        QVariantList deleteBits;
+        QVariantList names;
+        for (faiss::idx_t id : segmentIds) {
+            ids << static_cast<qlonglong>(id);
+            deleteBits << 0;
+            names << indexName;
+        }
 
-    try {
-        faiss::write_index(index, indexPath.toStdString().c_str());
-        return true;
-    } catch (faiss::FaissException &e) {
-        std::cerr << "Faiss error: " << e.what() << std::endl;
+        QString insert = "INSERT INTO " + QString(kEmbeddingDBIndexSegTable)
+                + " (id, " + QString(kEmbeddingDBSegIndexTableBitSet)
+                + ", " + QString(kEmbeddingDBSegIndexIndexName) + ") VALUES (?, ?, ?)";
+        bool ok = false;
+        {
+            QMutexLocker lk(dbMtx);
+            ok = EmbedDBVendorIns->executeBatch(dataBase, insert, { ids, deleteBits, names });
+        }
+
+        if (!ok) {
+            qWarning() << appID << "insert index segment rows failed, remove" << indexName;
+            QFile::remove(indexPath);
+            segmentManager->invalidate(indexName);
+            return false;
+        }
     }
 
+    segmentIds.clear();
+    segmentManager->initDeleted(indexName);
+    segmentManager->invalidate(indexName);
     return true;
 }
 
-void VectorIndex::resetCacheIndex(int d, const QMap<faiss::idx_t, QVector<float> > &embedVectorCache)
+void VectorIndex::removeCacheIds(const QVector<faiss::idx_t> &ids)
 {
-    QVector<float> embeddingsTmp;
-    QVector<faiss::idx_t> idsTmp;
-    for (auto id : embedVectorCache.keys()) {
-        embeddingsTmp += embedVectorCache.value(id);
-        idsTmp << id;
-    }
+    if (ids.isEmpty())
+        return;
 
     QMutexLocker lk(&vectorIndexMtx);
-    if (!cacheIndex) {
-        faiss::Index *index = faiss::index_factory(d, kFaissFlatIndex);
-        cacheIndex = new faiss::IndexIDMap(index);
-    }
-
-    cacheIndex->reset();
-    cacheIndex->add_with_ids(embedVectorCache.count(), embeddingsTmp.data(), idsTmp.data());
-    int newnTotal = cacheIndex->ntotal;
+    if (!cacheIndex || cacheIndex->ntotal == 0)
+        return;
 
-    segmentIds.clear();
-    segmentIds += idsTmp;   //每个segment的索引所对应的IDs
-    dumpIndexIDRange = qMakePair(cacheIndex->id_map.front(), cacheIndex->id_map.back());
-    lk.unlock();
+    // 只删除给定的id，其余向量保持不动
+    faiss::IDSelectorBatch sel(ids.size(), ids.constData());
+    size_t removed = cacheIndex->remove_ids(sel);
 
-    if (newnTotal >= 100) {
-        // UOS-AI添加文档后在内存中，与已经落盘的区分开，手动操作落盘；整理索引碎片等操作。
-        Q_EMIT indexDump();
+    QSet<faiss::idx_t> removeSet;
+    for (faiss::idx_t id : ids)
+        removeSet.insert(id);
+    QVector<faiss::idx_t> remain;
+    remain.reserve(segmentIds.size());
+    for (faiss::idx_t id : segmentIds) {
+        if (!removeSet.contains(id))
+            remain << id;
     }
+    segmentIds.swap(remain);
+
+    if (cacheIndex->id_map.empty())
+        dumpIndexIDRange = qMakePair(0, -1);
+    else
+        dumpIndexIDRange = qMakePair(cacheIndex->id_map.front(), cacheIndex->id_map.back());
+    qInfo() << "remove from cache index" << removed << "remain" << cacheIndex->ntotal;
+}
+
+void VectorIndex::markDumpDeleted(const QHash<QString, QVector<faiss::idx_t>> &idsBySegment)
+{
+    if (!idsBySegment.isEmpty())
+        segmentManager->markDeleted(idsBySegment);
 }
 
-void VectorIndex::vectorSearch(int topK, const float *queryVector,
-                               QMap<float, faiss::idx_t> &cacheSearchRes, QMap<float, faiss::idx_t> &dumpSearchRes)
+VectorSearchResult VectorIndex::vectorSearch(int topK, const float *queryVector)
 {
-    //QMap<float, faiss::idx_t> searchResult;  <L2距离, ID> Map小到大排序 合并cache和dump两个结果
+    // <L2距离, ID> 按距离从小到大排列，缓存与落盘的结果合并为一个top-K
+    VectorSearchResult searchResult;
+    if (topK <= 0)
+        return searchResult;
+
     if (appID == kSystemAssistantKey) {
        //TODO:区分社区版、专业版
-        QString indexPath = QString(kSystemAssistantData) + ".faiss";
-        faiss::Index *index;
-        try {
-            index = faiss::read_index(indexPath.toStdString().c_str());
-        } catch (faiss::FaissException &e) {
-            std::cerr << "Faiss error: " << e.what() << std::endl;
-            return;
-        }
+        QSharedPointer<faiss::Index> index = systemAssistantIndex();
+        if (!index)
+            return searchResult;
 
         QVector<float> D1(topK);
         QVector<faiss::idx_t> I1(topK);
@@ -174,76 +220,72 @@ void VectorIndex::vectorSearch(int topK, const float *queryVector,
             if (I1[id] == -1 || D1[id] == 0.f)
                 //faiss search -1 表示错误结果
                 break;
-            dumpSearchRes.insert(D1[id], I1[id]);
+            searchResult.append(qMakePair(D1[id], I1[id]));
         }
-        return;
+        return searchResult;
     }
 
-    //缓存向量检索
-    qInfo() << "load faiss index from cache...";
-    QVector<float> D1Cache(topK);
-    QVector<faiss::idx_t> I1Cache(topK);
+    // 索引段常驻内存，只有新增或变化的段才会读盘
+    qint64 loadTime = 0;
+    QList<SegmentManager::SegmentPtr> segments = segmentManager->segments(&loadTime);
 
-    {
-        QMutexLocker lk(&vectorIndexMtx);
-        if (cacheIndex) {
-            cacheIndex->search(1, queryVector, topK, D1Cache.data(), I1Cache.data());
-        }
-    }
+    const int nprobe = ConfigManagerIns->value(VECTOR_INDEX_GROUP, VECTOR_INDEX_NPROBE, kDefaultNProbe).toInt();
 
-    for (int i = 0; i < topK; i++) {
-        if (I1Cache[i] == -1 || D1Cache[i] == 0.f)
-            //faiss search -1 表示错误结果
-            break;
-        cacheSearchRes.insert(D1Cache[i], I1Cache[i]);
-    }
-    qInfo() << "cache search result***: " << I1Cache;
-
-    //落盘的索引检索
-    qInfo() << "load faiss index from dump...";
-    QString indexDirStr = workerDir() + QDir::separator() + appID;
-    QDir indexDir(indexDirStr);
-
-    if (!indexDir.exists()) {
-        if (!indexDir.mkpath(indexDirStr)) {
-            qWarning() << appID << " directory isn't exists and can't create!";
-            return;
-        }
-    }
-    QVector<uint8_t> deleteBitset = getDumpDeleteBitSet();
+    // 分片0为内存中的缓存索引，其余为落盘的索引段，各分片并行检索
+    const int nshard = segments.size() + 1;
+    std::vector<float> allDistances(static_cast<size_t>(nshard) * topK);
+    std::vector<faiss::idx_t> allLabels(static_cast<size_t>(nshard) * topK, -1);
+    QVector<int> shards(nshard);
+    std::iota(shards.begin(), shards.end(), 0);
 
-    QHash<QString, int> indexFilesNum = getIndexFilesNum();
-    for (int i = 0; i < indexFilesNum.value(QString(kFaissFlatIndex)); i++) {
-        QString name = QString(kFaissFlatIndex) + "_" + QString::number(i) + ".faiss";
-        QString indexPath = indexDir.path() + QDir::separator() + name;
-
-        faiss::Index *index;
+    QElapsedTimer searchTimer;
+    searchTimer.start();
+    QtConcurrent::blockingMap(shards, [&](const int &shard) {
+        float *D = allDistances.data() + static_cast<size_t>(shard) * topK;
+        faiss::idx_t *I = allLabels.data() + static_cast<size_t>(shard) * topK;
         try {
-            index = faiss::read_index(indexPath.toStdString().c_str());
+            if (shard == 0) {
+                QMutexLocker lk(&vectorIndexMtx);
+                if (cacheIndex && cacheIndex->ntotal > 0)
+                    cacheIndex->search(1, queryVector, topK, D, I);
+                return;
+            }
+
+            const SegmentManager::SegmentPtr &seg = segments.at(shard - 1);
+            // IVF段只检索nprobe个倒排表，Flat段全量检索；段的删除集合常驻内存，直接作为过滤条件
+            faiss::SearchParametersIVF ivfParam;
+            ivfParam.nprobe = static_cast<size_t>(qMax(1, nprobe));
+            faiss::SearchParameters flatParam;
+            faiss::SearchParameters &param = seg->type == kFaissFlatIndex ? flatParam : ivfParam;
+            param.sel = seg->deleted ? &seg->deleted->selector : nullptr;
+            seg->index->search(1, queryVector, topK, D, I, &param);
         } catch (faiss::FaissException &e) {
             std::cerr << "Faiss error: " << e.what() << std::endl;
-            return;
+            std::fill(I, I + topK, -1);
         }
+    });
 
-        faiss::IDSelectorBitmap *idSelect = new faiss::IDSelectorBitmap(deleteBitset.size(), deleteBitset.data());
-        faiss::SearchParameters *param = new faiss::SearchParameters();
-        param->sel = idSelect;
+    // 各分片结果已按距离有序，k路堆合并
+    std::vector<float> distances(static_cast<size_t>(topK));
+    std::vector<faiss::idx_t> labels(static_cast<size_t>(topK));
+    faiss::merge_knn_results<faiss::idx_t, faiss::CMin<float, int>>(
+            1, static_cast<size_t>(topK), nshard, allDistances.data(), allLabels.data(), distances.data(), labels.data());
 
-        QVector<float> D1(topK);
-        QVector<faiss::idx_t> I1(topK);
-        index->search(1, queryVector, topK, D1.data(), I1.data(), param);
-
-        for (int id = 0; id < topK; id++) {
-            if (I1[id] == -1 || D1[id] == 0.f)
-                //faiss search -1 表示错误结果
-                break;
-            dumpSearchRes.insert(D1[id], I1[id]);
-        }
-        qInfo() << "dump search result***: " << I1;
+    for (int i = 0; i < topK; i++) {
+        if (labels[i] == -1)
+            //faiss search -1 表示错误结果
+            break;
+        if (distances[i] == 0.f)
+            continue;
+        searchResult.append(qMakePair(distances[i], labels[i]));
     }
 
+    qInfo() << appID << "search shards:" << nshard << "load time:" << loadTime
+            << "ms, search time:" << searchTimer.elapsed() << "ms";
+
     //检索结果处理
     //TODO:检索结果后处理-去重、过于相近或远
+    return searchResult;
 }
 
 QPair<faiss::idx_t, faiss::idx_t> VectorIndex::getDumpIndexIDRange()
@@ -252,16 +294,181 @@ QPair<faiss::idx_t, faiss::idx_t> VectorIndex::getDumpIndexIDRange()
     return dumpIndexIDRange;
 }
 
-void VectorIndex::doIndexDump()
+faiss::idx_t VectorIndex::getDumpedIndexID()
 {
     QMutexLocker lk(&vectorIndexMtx);
+    return dumpedID;
+}
 
-    if (!cacheIndex)
-        return;
+bool VectorIndex::doIndexDump()
+{
+    QMutexLocker lk(&vectorIndexMtx);
+
+    if (!cacheIndex || cacheIndex->ntotal == 0)
+        return false;
+
+    // 落盘失败时向量留在缓存索引中，仍可检索，下次落盘重试
+    const faiss::idx_t lastID = cacheIndex->id_map.back();
+    if (!saveIndexToFile(cacheIndex, kFaissFlatIndex))
+        return false;
 
-    saveIndexToFile(cacheIndex, kFaissFlatIndex);
+    dumpedID = qMax(dumpedID, lastID);
     cacheIndex->reset();
     dumpIndexIDRange = qMakePair(0, -1);
+
+    // 小段过多时在后台合并为IVF段
+    const int threshold = ConfigManagerIns->value(VECTOR_INDEX_GROUP, VECTOR_INDEX_COMPACT_SEGMENTS, kCompactSegmentsThreshold).toInt();
+    if (getIndexFilesNum().value(kFaissFlatIndex) >= threshold && compacting.testAndSetOrdered(0, 1))
+        QtConcurrent::run(&compactPool, [this]() { compactSegments(); });
+    return true;
+}
+
+void VectorIndex::compactSegments()
+{
+    struct Finish {
+        QAtomicInt &flag;
+        ~Finish() { flag.storeRelease(0); }
+    } finish { compacting };
+
+    QList<SegmentManager::SegmentPtr> flatSegments;
+    QSet<faiss::idx_t> deletedIds;
+    faiss::idx_t remain = 0;
+    for (const SegmentManager::SegmentPtr &seg : segmentManager->segments()) {
+        if (seg->type != kFaissFlatIndex)
+            continue;
+
+        flatSegments << seg;
+        remain += seg->index->ntotal;
+        if (seg->deleted) {
+            // Flat段的删除集合只含本段的id
+            remain -= static_cast<faiss::idx_t>(seg->deleted->ids.size());
+            for (faiss::idx_t id : seg->deleted->ids)
+                deletedIds.insert(id);
+        }
+    }
+    if (flatSegments.size() < 2)
+        return;
+
+    // 向量不足以训练IVF时不取出向量
+    if (remain < kIvfMinTrainSize) {
+        qInfo() << appID << "too few vectors to compact:" << remain;
+        return;
+    }
+
+    // 取出各Flat段中未删除的向量
+    int d = 0;
+    QStringList mergedNames;
+    QVariantList droppedIds;
+    std::vector<float> vectors;
+    std::vector<faiss::idx_t> ids;
+    for (const SegmentManager::SegmentPtr &seg : flatSegments) {
+        const faiss::IndexIDMap *idMap = dynamic_cast<const faiss::IndexIDMap *>(seg->index.data());
+        if (!idMap || (d != 0 && idMap->d != d))
+            continue;
+
+        d = idMap->d;
+        std::vector<float> segVectors(static_cast<size_t>(idMap->ntotal) * d);
+        idMap->index->reconstruct_n(0, idMap->ntotal, segVectors.data());
+        for (faiss::idx_t i = 0; i < idMap->ntotal; i++) {
+            faiss::idx_t id = idMap->id_map[i];
+            if (deletedIds.contains(id)) {
+                droppedIds << static_cast<qlonglong>(id);
+                continue;
+            }
+            ids.push_back(id);
+            vectors.insert(vectors.end(), segVectors.begin() + i * d, segVectors.begin() + (i + 1) * d);
+        }
+        mergedNames << seg->name;
+    }
+
+    const faiss::idx_t n = static_cast<faiss::idx_t>(ids.size());
+    if (n < kIvfMinTrainSize) {
+        qInfo() << appID << "too few vectors to compact:" << n;
+        return;
+    }
+
+    // nlist取4*sqrt(n)，并保证每个聚类中心至少有39个训练点
+    const int nlist = qMax(1, qMin(static_cast<int>(4 * std::sqrt(n)), static_cast<int>(n / 39)));
+    const bool usePQ = n >= kIvfPQThreshold && d % 16 == 0;
+    const QString indexType = usePQ ? kFaissIvfPQIndex : kFaissIvfFlatIndex;
+    const QString description = usePQ ? QString("IVF%0,PQ%1").arg(nlist).arg(d / 16)
+                                      : QString("IVF%0,Flat").arg(nlist);
+
+    QElapsedTimer timer;
+    timer.start();
+    QScopedPointer<faiss::Index> index;
+    try {
+        index.reset(faiss::index_factory(d, description.toStdString().c_str()));
+        index->train(n, vectors.data());
+        index->add_with_ids(n, vectors.data(), ids.data());
+    } catch (faiss::FaissException &e) {
+        std::cerr << "Faiss error: " << e.what() << std::endl;
+        return;
+    }
+
+    QString indexDirStr = workerDir() + QDir::separator() + appID;
+    QString indexName = indexType + "_" + QString::number(nextSegmentNumber(indexType)) + ".faiss";
+    QString tmpPath = indexDirStr + QDir::separator() + indexName + ".tmp";
+    try {
+        faiss::write_index(index.data(), tmpPath.toStdString().c_str());
+    } catch (faiss::FaissException &e) {
+        std::cerr << "Faiss error: " << e.what() << std::endl;
+        QFile::remove(tmpPath);
+        return;
+    }
+
+    // 先记录合并并写好新段的删除集合，再切换index_segment表，最后替换段文件；中途退出时
+    // 下次启动按表是否已切换完成或撤销。已删除的行先移除，撤销时旧段的删除集合仍会过滤它们
+    QVariantList newNames;
+    QVariantList oldNames;
+    for (const QString &name : mergedNames) {
+        newNames << indexName;
+        oldNames << name;
+    }
+    QString update = "UPDATE " + QString(kEmbeddingDBIndexSegTable) + " SET " + QString(kEmbeddingDBSegIndexIndexName)
+            + " = ? WHERE " + QString(kEmbeddingDBSegIndexIndexName) + " = ?";
+    QString remove = "DELETE FROM " + QString(kEmbeddingDBIndexSegTable) + " WHERE id = ?";
+
+    // 删除操作在同一把锁内查询所在段并写删除集合，不会落在表切换与段替换之间
+    QMutexLocker lk(dbMtx);
+    if (!segmentManager->beginReplace(mergedNames, indexName)) {
+        qWarning() << appID << "compact index segments failed";
+        QFile::remove(tmpPath);
+        return;
+    }
+
+    bool ok = true;
+    if (!droppedIds.isEmpty())
+        ok = EmbedDBVendorIns->executeBatch(dataBase, remove, { droppedIds });
+    if (ok)
+        ok = EmbedDBVendorIns->executeBatch(dataBase, update, { newNames, oldNames });
+    if (!ok) {
+        qWarning() << appID << "compact index segments failed";
+        segmentManager->abortReplace(indexName);
+        QFile::remove(tmpPath);
+        return;
+    }
+
+    if (!segmentManager->replace(mergedNames, tmpPath, indexName))
+        return;
+    lk.unlock();
+
+    qInfo() << appID << "compact" << mergedNames << "to" << indexName << "vectors:" << n
+            << "dropped:" << droppedIds.size() << "spending:" << timer.elapsed();
+}
+
+void VectorIndex::recoverSegments()
+{
+    segmentManager->recover([this](const QString &name, bool *committed) -> bool {
+        QList<QVariantList> result;
+        QString query = "SELECT id FROM " + QString(kEmbeddingDBIndexSegTable) + " WHERE "
+                + QString(kEmbeddingDBSegIndexIndexName) + " = ? LIMIT 1";
+        QMutexLocker lk(dbMtx);
+        if (!EmbedDBVendorIns->executePreparedQuery(dataBase, query, { name }, result))
+            return false;
+        *committed = !result.isEmpty();
+        return true;
+    });
 }
 
 QHash<QString, int> VectorIndex::getIndexFilesNum()
@@ -279,39 +486,45 @@ QHash<QString, int> VectorIndex::getIndexFilesNum()
 
     QFileInfoList fileList = indexDir.entryInfoList(QDir::Files);
 
-    for (QString indexTypeKey : {kFaissFlatIndex, kFaissIvfFlatIndex, kFaissIvfPQIndex}) {
-        int count = 0;
-        for (const QFileInfo& fileInfo : fileList) {
-            QString fileName = fileInfo.fileName();
-            if (fileName.contains(indexTypeKey))
-                count += 1;
-            result.insert(indexTypeKey, count);
-        }
+    for (QString indexTypeKey : {kFaissFlatIndex, kFaissIvfFlatIndex, kFaissIvfPQIndex})
+        result.insert(indexTypeKey, 0);
+
+    for (const QFileInfo& fileInfo : fileList) {
+        QString indexType;
+        if (SegmentManager::isSegmentFile(fileInfo.fileName(), &indexType))
+            result[indexType] += 1;
     }
     return result;
 }
 
-QVector<uint8_t> VectorIndex::getDumpDeleteBitSet()
+int VectorIndex::nextSegmentNumber(const QString &indexType)
 {
-    QList<QVariantList> result;
-    QString query = "SELECT * FROM " + QString(kEmbeddingDBIndexSegTable);
-    {
-        QMutexLocker lk(dbMtx);
-        EmbedDBVendorIns->executeQuery(dataBase, query, result);
+    // 现有最大编号+1，合并删除旧段后编号不连续也不会重名
+    QDir indexDir(workerDir() + QDir::separator() + appID);
+    int next = 0;
+    for (const QString &fileName : indexDir.entryList(QDir::Files)) {
+        QString type;
+        if (!SegmentManager::isSegmentFile(fileName, &type) || type != indexType)
+            continue;
+
+        int num = fileName.section('_', 1).section('.', 0, 0).toInt();
+        next = qMax(next, num + 1);
     }
+    return next;
+}
 
-    int bitmapSize = static_cast<int>(std::ceil((result.size() >> 3)));
-    if (bitmapSize == 0)
-        bitmapSize += 1;
-    QVector<uint8_t> bitmap(bitmapSize);
-    for (int i = 0; i < bitmapSize; i++) {
-        for (int j = 0; j < 8; j++) {
-            if ((i * 8 + j) >= result.size())
-                break;
-            if (result[i * 8 + j][1].isValid())
-                bitmap[i] |= (!result[i * 8 + j][1].toBool() << j);
-        }
-   }
-
-   return bitmap;
+QVector<faiss::idx_t> VectorIndex::loadLegacyDeleted(const QString &segment)
+{
+    QList<QVariantList> result;
+    QString query = "SELECT id FROM " + QString(kEmbeddingDBIndexSegTable) + " WHERE "
+            + QString(kEmbeddingDBSegIndexIndexName) + " = ? AND " + QString(kEmbeddingDBSegIndexTableBitSet) + " = 1";
+    QSqlDatabase reader = EmbedDBVendorIns->readerDatabase(dataBase);
+    EmbedDBVendorIns->executePreparedQuery(&reader, query, { segment }, result);
+
+    QVector<faiss::idx_t> ids;
+    for (const QVariantList &res : result) {
+        if (!res.isEmpty() && res[0].isValid())
+            ids << res[0].toLongLong();
+    }
+    return ids;
 }
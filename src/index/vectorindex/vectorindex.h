@@ -12,23 +12,34 @@
 
 #include <QSqlDatabase>
 #include <QMutex>
+#include <QThreadPool>
+#include <QAtomicInt>
+
+#include "segmentmanager.h"
+#include "vectorstore.h"
 
 #include <faiss/Index.h>
 #include <faiss/IndexFlat.h>
 #include <faiss/IndexIDMap.h>
 
+// <L2距离, ID>，按距离升序
+typedef QVector<QPair<float, faiss::idx_t>> VectorSearchResult;
+
 class VectorIndex : public QObject
 {
     Q_OBJECT
 
 public:
     explicit VectorIndex(QSqlDatabase *db, QMutex *mtx, const QString &appID, QObject *parent = nullptr);
-    bool updateIndex(int d, const QMap<faiss::idx_t, QVector<float>> &embedVectorCache);
+    ~VectorIndex();
+    bool updateIndex(int d, const VectorStore &store);
     bool saveIndexToFile(const faiss::Index *index, const QString &indexType="All");
 
     //DB Operate
-    void resetCacheIndex(int d, const QMap<faiss::idx_t, QVector<float>> &embedVectorCache);
-    void vectorSearch(int topK, const float *queryVector, QMap<float, faiss::idx_t> &cacheSearchRes, QMap<float, faiss::idx_t> &dumpSearchRes);
+    void removeCacheIds(const QVector<faiss::idx_t> &ids);
+    // 落盘段中被删除的id，按段名分组
+    void markDumpDeleted(const QHash<QString, QVector<faiss::idx_t>> &idsBySegment);
+    VectorSearchResult vectorSearch(int topK, const float *queryVector);
 
     inline static QString workerDir()
     {
@@ -38,17 +49,28 @@ public:
     }
 
     QPair<faiss::idx_t, faiss::idx_t> getDumpIndexIDRange();
+    // 已写入段文件的最大id
+    faiss::idx_t getDumpedIndexID();
 
-    void doIndexDump();
+    bool doIndexDump();
+    void compactSegments();
+    // 完成或撤销上次中途退出的段合并，数据库打开后调用
+    void recoverSegments();
 signals:
     void indexDump();
 private:
     QHash<QString, int> getIndexFilesNum();
-    QVector<uint8_t> getDumpDeleteBitSet();
+    int nextSegmentNumber(const QString &indexType);
+    static QSharedPointer<faiss::Index> systemAssistantIndex();
+    QVector<faiss::idx_t> loadLegacyDeleted(const QString &segment);
 
-    faiss::IndexIDMap *cacheIndex = nullptr;
+    faiss::IndexIDMap2 *cacheIndex = nullptr;
     QVector<faiss::idx_t> segmentIds;
     QPair<faiss::idx_t, faiss::idx_t> dumpIndexIDRange;
+    faiss::idx_t dumpedID = -1;
+    SegmentManager *segmentManager = nullptr;
+    QThreadPool compactPool;    // 后台合并段，析构时在此等待
+    QAtomicInt compacting { 0 };
 
     QSqlDatabase *dataBase = nullptr;
     QMutex *dbMtx = nullptr;
@@ -0,0 +1,93 @@
+// SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "vectorstore.h"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+static constexpr size_t kAlignment = 64;
+static constexpr size_t kInitRows = 128;
+
+VectorStore::VectorStore(int dim)
+    : dim(dim)
+{
+    Q_ASSERT(dim > 0);
+}
+
+VectorStore::~VectorStore()
+{
+    free(buffer);
+}
+
+void VectorStore::append(faiss::idx_t id, const float *vector)
+{
+    Q_ASSERT(idList.empty() || idList.back() < id);
+
+    if (idList.size() == capacity)
+        grow(capacity ? capacity * 2 : kInitRows);
+
+    memcpy(buffer + idList.size() * static_cast<size_t>(dim), vector, static_cast<size_t>(dim) * sizeof(float));
+    idList.push_back(id);
+}
+
+faiss::idx_t VectorStore::upperBound(faiss::idx_t id) const
+{
+    auto it = std::upper_bound(idList.begin(), idList.end(), id);
+    return static_cast<faiss::idx_t>(it - idList.begin());
+}
+
+int VectorStore::remove(const QSet<faiss::idx_t> &removeIds)
+{
+    if (removeIds.isEmpty())
+        return 0;
+
+    // 单遍前移压实
+    const size_t rowBytes = static_cast<size_t>(dim) * sizeof(float);
+    size_t keep = 0;
+    for (size_t row = 0; row < idList.size(); ++row) {
+        if (removeIds.contains(idList[row]))
+            continue;
+
+        if (keep != row) {
+            memmove(buffer + keep * static_cast<size_t>(dim), buffer + row * static_cast<size_t>(dim), rowBytes);
+            idList[keep] = idList[row];
+        }
+        ++keep;
+    }
+
+    const int removed = static_cast<int>(idList.size() - keep);
+    idList.resize(keep);
+    return removed;
+}
+
+void VectorStore::clear()
+{
+    // 保留已分配的内存，下一批文档继续使用
+    idList.clear();
+}
+
+void VectorStore::grow(size_t rows)
+{
+    void *mem = nullptr;
+    size_t bytes = rows * static_cast<size_t>(dim) * sizeof(float);
+    bytes = (bytes + kAlignment - 1) / kAlignment * kAlignment;
+    if (posix_memalign(&mem, kAlignment, bytes) != 0) {
+        qCritical() << "can not allocate vector store" << bytes;
+        throw std::bad_alloc();
+    }
+
+    if (buffer) {
+        memcpy(mem, buffer, idList.size() * static_cast<size_t>(dim) * sizeof(float));
+        free(buffer);
+    }
+
+    buffer = static_cast<float *>(mem);
+    capacity = rows;
+    idList.reserve(rows);
+}
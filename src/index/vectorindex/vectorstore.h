@@ -0,0 +1,48 @@
+// SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef VECTORSTORE_H
+#define VECTORSTORE_H
+
+#include <QSet>
+
+#include <faiss/Index.h>
+
+#include <vector>
+
+// 未落盘向量的存储：按写入顺序连续存放在64字节对齐的内存中，id数组与之一一对应，
+// 可直接交给faiss的add_with_ids，不再逐个拷贝。写入与读取都在索引工作线程中进行
+class VectorStore
+{
+public:
+    explicit VectorStore(int dim);
+    ~VectorStore();
+
+    inline int dimension() const { return dim; }
+    inline faiss::idx_t size() const { return static_cast<faiss::idx_t>(idList.size()); }
+    inline bool isEmpty() const { return idList.empty(); }
+
+    // 第row行向量及其后续行的起始地址
+    inline const float *vectors(faiss::idx_t row = 0) const { return buffer + row * dim; }
+    inline const faiss::idx_t *ids(faiss::idx_t row = 0) const { return idList.data() + row; }
+
+    // id须大于已有的id
+    void append(faiss::idx_t id, const float *vector);
+    // 第一个id大于给定id的行
+    faiss::idx_t upperBound(faiss::idx_t id) const;
+    // 删除给定id，保持剩余行的顺序
+    int remove(const QSet<faiss::idx_t> &removeIds);
+    void clear();
+
+private:
+    Q_DISABLE_COPY(VectorStore)
+    void grow(size_t rows);
+
+    int dim = 0;
+    float *buffer = nullptr;
+    size_t capacity = 0;
+    std::vector<faiss::idx_t> idList;
+};
+
+#endif // VECTORSTORE_H
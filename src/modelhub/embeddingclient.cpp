@@ -0,0 +1,495 @@
+// SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "embeddingclient.h"
+#include "modelhubwrapper.h"
+
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QTimer>
+#include <QDateTime>
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// 同时在途的批次数
+static constexpr int kMaxInFlightBatches = 4;
+// 单个请求的超时时间(毫秒)
+static constexpr int kRequestTimeout = 60 * 1000;
+// 检索问题在D-Bus线程上等待，超时更短
+static constexpr int kQueryTimeout = 10 * 1000;
+
+// 批次大小的初始值与调整范围
+static constexpr int kInitBatchSize = 15;
+static constexpr int kMinBatchSize = 1;
+static constexpr int kMaxBatchSize = 64;
+// 每个批次大小采样的请求数
+static constexpr int kAdjustWindow = 4;
+
+// 缓存的检索问题数及有效期(毫秒)
+static constexpr int kQueryCacheSize = 256;
+static constexpr qint64 kQueryCacheTTL = 10 * 60 * 1000;
+
+EmbeddingClient::EmbeddingClient(ModelhubWrapper *model)
+    : QObject()
+    , model(model)
+    , inFlight(kMaxInFlightBatches)
+    , currentBatchSize(kInitBatchSize)
+    , queryCache(kQueryCacheSize)
+{
+    Q_ASSERT(model);
+    workThread.setObjectName("EmbeddingClient");
+    moveToThread(&workThread);
+    workThread.start();
+}
+
+EmbeddingClient::~EmbeddingClient()
+{
+    // 网络对象需在所属线程中释放
+    QMetaObject::invokeMethod(this, [this]() { shutdown(); }, Qt::BlockingQueuedConnection);
+    workThread.quit();
+    workThread.wait();
+}
+
+QFuture<EmbeddingResult> EmbeddingClient::post(const QStringList &texts, int batchSize)
+{
+    if (texts.isEmpty())
+        return emptyResult();
+
+    // 在途批次已满时在调用线程等待，形成背压
+    inFlight.acquire();
+    return send(texts, false, batchSize);
+}
+
+QFuture<EmbeddingResult> EmbeddingClient::postQuery(const QString &query)
+{
+    return send({ query }, true, 0);
+}
+
+QFuture<EmbeddingResult> EmbeddingClient::send(const QStringList &texts, bool priority, int batchSize)
+{
+    Request req;
+    req.promise.reportStarted();
+    req.texts = texts;
+    req.priority = priority;
+    req.batchSize = batchSize;
+    QFuture<EmbeddingResult> future = req.promise.future();
+
+    QMetaObject::invokeMethod(this, [this, req]() {
+        doPost(req);
+    }, Qt::QueuedConnection);
+
+    return future;
+}
+
+QList<EmbeddingClient::Batch> EmbeddingClient::embed(const QStringList &texts)
+{
+    QList<Batch> batches;
+    if (texts.isEmpty())
+        return batches;
+
+    // 长度相近的文本放在同一批，减少服务端按最长文本补齐的开销
+    QVector<int> order(texts.size());
+    for (int i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&texts](int a, int b) {
+        return texts.at(a).size() < texts.at(b).size();
+    });
+
+    const bool running = model->ensureRunning();
+    int pos = 0;
+    while (pos < order.size()) {
+        Batch batch;
+        const int size = batchSize();
+        batch.indexes = order.mid(pos, size);
+        pos += batch.indexes.size();
+
+        if (!running) {
+            batch.reply = emptyResult();
+            batches << batch;
+            continue;
+        }
+
+        QStringList subList;
+        for (int idx : batch.indexes)
+            subList << texts.at(idx);
+        batch.reply = post(subList, size);
+        batches << batch;
+    }
+
+    return batches;
+}
+
+bool EmbeddingClient::embedQuery(const QString &query, QVector<float> &vector)
+{
+    {
+        QMutexLocker lk(&queryMtx);
+        // object()会将命中项移到最近使用
+        QueryEntry *entry = queryCache.object(query);
+        if (entry && QDateTime::currentMSecsSinceEpoch() - entry->time < kQueryCacheTTL) {
+            vector = entry->vector;
+            queryHits++;
+            return true;
+        }
+        if (entry)
+            queryCache.remove(query);
+        queryMisses++;
+    }
+
+    if (!model->ensureRunning())
+        return false;
+
+    const EmbeddingResult result = postQuery(query).result();
+    if (!result.isValid())
+        return false;
+
+    vector = QVector<float>(result.dim);
+    memcpy(vector.data(), result.vector(0), static_cast<size_t>(result.dim) * sizeof(float));
+
+    QueryEntry *entry = new QueryEntry;
+    entry->vector = vector;
+    entry->time = QDateTime::currentMSecsSinceEpoch();
+    QMutexLocker lk(&queryMtx);
+    queryCache.insert(query, entry);
+    return true;
+}
+
+QString EmbeddingClient::modelName() const
+{
+    return model->model();
+}
+
+int EmbeddingClient::batchSize() const
+{
+    QMutexLocker lk(&statsMtx);
+    return currentBatchSize;
+}
+
+QJsonObject EmbeddingClient::diagnostics() const
+{
+    QMutexLocker lk(&statsMtx);
+    qint64 busy = busyTime;
+    if (busyTimer.isValid())
+        busy += busyTimer.elapsed();
+
+    QJsonObject obj;
+    obj["batchSize"] = currentBatchSize;
+    obj["requests"] = requests;
+    obj["failures"] = failures;
+    obj["chunks"] = chunks;
+    obj["avgLatency"] = avgLatency;
+    // 有请求在途期间的实际吞吐(块/秒)
+    obj["chunksPerSecond"] = busy > 0 ? chunks * 1000.0 / busy : 0.0;
+    lk.unlock();
+
+    QMutexLocker qlk(&queryMtx);
+    QJsonObject query;
+    query["size"] = queryCache.count();
+    query["hits"] = queryHits;
+    query["misses"] = queryMisses;
+    const qint64 lookups = queryHits + queryMisses;
+    query["hitRate"] = lookups > 0 ? static_cast<double>(queryHits) / lookups : 0.0;
+    obj["queryCache"] = query;
+    return obj;
+}
+
+QFuture<EmbeddingResult> EmbeddingClient::emptyResult()
+{
+    QFutureInterface<EmbeddingResult> promise;
+    promise.reportStarted();
+    EmbeddingResult empty;
+    promise.reportFinished(&empty);
+    return promise.future();
+}
+
+void EmbeddingClient::doPost(Request req)
+{
+    // 长连接复用，首次使用时在工作线程中创建
+    if (!manager)
+        manager = new QNetworkAccessManager(this);
+
+    QNetworkRequest request(model->urlPath("/embeddings"));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+    if (req.priority)
+        request.setPriority(QNetworkRequest::HighPriority);
+
+    QJsonObject data;
+    data["input"] = QJsonArray::fromStringList(req.texts);
+    // 向量以base64编码的float32返回，避免逐个解析浮点文本
+    if (useBase64)
+        data["encoding_format"] = "base64";
+
+    if (pending.isEmpty()) {
+        QMutexLocker lk(&statsMtx);
+        busyTimer.start();
+    }
+
+    QNetworkReply *reply = manager->post(request, QJsonDocument(data).toJson(QJsonDocument::Compact));
+    req.count = req.texts.size();
+    req.base64 = useBase64;
+    req.timer.start();
+    pending.insert(reply, req);
+
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+        onReplyFinished(reply);
+    });
+    QTimer::singleShot(req.priority ? kQueryTimeout : kRequestTimeout, reply, &QNetworkReply::abort);
+}
+
+void EmbeddingClient::onReplyFinished(QNetworkReply *reply)
+{
+    if (!pending.contains(reply))
+        return;
+
+    Request req = pending.take(reply);
+    const qint64 latency = req.timer.elapsed();
+
+    const int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    EmbeddingResult result;
+    if (reply->error() == QNetworkReply::NoError) {
+        if (!parseReply(reply->readAll(), result) || result.count != req.count) {
+            qWarning() << "Invalid embedding reply, batch" << req.count;
+            result = EmbeddingResult();
+        }
+    } else {
+        qWarning() << "Failed to create embedding:" << reply->errorString() << "batch" << req.count;
+        // 连接类错误说明服务可能已退出，使健康状态缓存失效
+        if (httpStatus == 0)
+            model->invalidate();
+    }
+    reply->deleteLater();
+
+    // 服务端拒绝encoding_format参数，去掉后重发，不占用新的在途名额
+    if (req.base64 && httpStatus >= 400 && httpStatus < 500) {
+        qWarning() << "embedding server does not accept base64 encoding, fall back to json";
+        useBase64 = false;
+        if (pending.isEmpty()) {
+            QMutexLocker lk(&statsMtx);
+            busyTime += busyTimer.elapsed();
+            busyTimer.invalidate();
+        }
+        doPost(req);
+        return;
+    }
+
+    if (pending.isEmpty()) {
+        QMutexLocker lk(&statsMtx);
+        busyTime += busyTimer.elapsed();
+        busyTimer.invalidate();
+    }
+
+    // 检索问题不参与批次大小调整，也不占用在途名额
+    if (!req.priority)
+        adjustBatchSize(req, latency, result.isValid());
+
+    req.promise.reportFinished(&result);
+    if (!req.priority)
+        inFlight.release();
+}
+
+void EmbeddingClient::adjustBatchSize(const Request &req, qint64 latency, bool ok)
+{
+    QMutexLocker lk(&statsMtx);
+    requests++;
+    if (!ok) {
+        // 失败或超时，批次减半
+        failures++;
+        currentBatchSize = qMax(kMinBatchSize, currentBatchSize / 2);
+        windowSamples = 0;
+        windowChunks = 0;
+        windowThroughput = 0;
+        lastThroughput = 0;
+        return;
+    }
+
+    chunks += req.count;
+    avgLatency = avgLatency > 0 ? avgLatency * 0.8 + latency * 0.2 : latency;
+
+    // 按当前批次大小分出的批次都参与采样，未满的尾批按块数加权；调整前分出的批次不参与
+    if (req.batchSize != currentBatchSize)
+        return;
+
+    // 接近超时，主动缩小
+    if (latency > kRequestTimeout / 2) {
+        currentBatchSize = qMax(kMinBatchSize, currentBatchSize * 3 / 4);
+        windowSamples = 0;
+        windowChunks = 0;
+        windowThroughput = 0;
+        lastThroughput = 0;
+        return;
+    }
+
+    windowChunks += req.count;
+    windowThroughput += req.count * (req.count * 1000.0 / qMax<qint64>(latency, 1));
+    if (++windowSamples < kAdjustWindow)
+        return;
+
+    // 吞吐下降则反向调整
+    const double throughput = windowThroughput / windowChunks;
+    if (lastThroughput > 0 && throughput < lastThroughput * 0.95)
+        direction = -direction;
+    lastThroughput = throughput;
+
+    const int step = qMax(1, currentBatchSize / 4);
+    currentBatchSize = qBound(kMinBatchSize, currentBatchSize + direction * step, kMaxBatchSize);
+    windowSamples = 0;
+    windowChunks = 0;
+    windowThroughput = 0;
+}
+
+void EmbeddingClient::shutdown()
+{
+    // 结束所有未完成的请求，避免调用方一直等待
+    for (auto it = pending.begin(); it != pending.end(); ++it) {
+        QNetworkReply *reply = it.key();
+        disconnect(reply, nullptr, this, nullptr);
+        reply->abort();
+        reply->deleteLater();
+
+        EmbeddingResult empty;
+        it.value().promise.reportFinished(&empty);
+        if (!it.value().priority)
+            inFlight.release();
+    }
+    pending.clear();
+
+    {
+        QMutexLocker lk(&statsMtx);
+        busyTimer.invalidate();
+    }
+
+    delete manager;
+    manager = nullptr;
+}
+
+// 不依赖locale的浮点解析，JSON数字始终以'.'为小数点
+static const char *parseNumber(const char *p, const char *end, float &value)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+
+    const char *start = p;
+    quint64 mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + static_cast<quint64>(*p - '0');
+            if (mantissa)
+                ++digits;
+        } else {
+            ++exponent;
+        }
+    }
+
+    if (p < end && *p == '.') {
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + static_cast<quint64>(*p - '0');
+                if (mantissa)
+                    ++digits;
+                --exponent;
+            }
+        }
+    }
+
+    if (p == start)
+        return nullptr;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool expNegative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            expNegative = *p == '-';
+            ++p;
+        }
+        int exp = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p)
+            exp = qMin(exp * 10 + (*p - '0'), 1000);
+        exponent += expNegative ? -exp : exp;
+    }
+
+    double v = static_cast<double>(mantissa);
+    if (exponent != 0)
+        v *= std::pow(10.0, exponent);
+    value = static_cast<float>(negative ? -v : v);
+    return p;
+}
+
+static inline const char *skipSpace(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+        ++p;
+    return p;
+}
+
+bool EmbeddingClient::parseReply(const QByteArray &body, EmbeddingResult &result)
+{
+    // 只扫描"embedding"字段，不构建完整的JSON文档，向量直接写入连续缓冲区
+    static const QByteArray key("\"embedding\"");
+    result = EmbeddingResult();
+
+    const char *begin = body.constData();
+    const char *end = begin + body.size();
+    int from = 0;
+    while ((from = body.indexOf(key, from)) >= 0) {
+        const char *p = skipSpace(begin + from + key.size(), end);
+        from += key.size();
+        if (p >= end || *p != ':')
+            continue;
+        p = skipSpace(p + 1, end);
+        if (p >= end)
+            return false;
+
+        const size_t offset = result.data.size();
+        if (*p == '"') {
+            // base64编码的小端float32
+            const char *q = static_cast<const char *>(memchr(p + 1, '"', static_cast<size_t>(end - p - 1)));
+            if (!q)
+                return false;
+            const QByteArray raw = QByteArray::fromBase64(QByteArray::fromRawData(p + 1, static_cast<int>(q - p - 1)));
+            if (raw.isEmpty() || raw.size() % static_cast<int>(sizeof(float)) != 0)
+                return false;
+            result.data.resize(offset + raw.size() / sizeof(float));
+            memcpy(result.data.data() + offset, raw.constData(), static_cast<size_t>(raw.size()));
+            p = q + 1;
+        } else if (*p == '[') {
+            if (result.dim > 0)
+                result.data.reserve(offset + static_cast<size_t>(result.dim));
+            p = skipSpace(p + 1, end);
+            while (p < end && *p != ']') {
+                float value = 0;
+                p = parseNumber(p, end, value);
+                if (!p)
+                    return false;
+                result.data.push_back(value);
+                p = skipSpace(p, end);
+                if (p < end && *p == ',')
+                    p = skipSpace(p + 1, end);
+            }
+            if (p >= end)
+                return false;
+            ++p;
+        } else {
+            return false;
+        }
+
+        const int dim = static_cast<int>(result.data.size() - offset);
+        if (dim == 0 || (result.dim > 0 && dim != result.dim))
+            return false;
+        result.dim = dim;
+        result.count++;
+        from = static_cast<int>(p - begin);
+    }
+
+    return result.isValid();
+}
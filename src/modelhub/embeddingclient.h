@@ -0,0 +1,120 @@
+// SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef EMBEDDINGCLIENT_H
+#define EMBEDDINGCLIENT_H
+
+#include <QObject>
+#include <QThread>
+#include <QFuture>
+#include <QFutureInterface>
+#include <QJsonObject>
+#include <QSemaphore>
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+#include <QElapsedTimer>
+#include <QCache>
+
+#include <vector>
+
+class QNetworkAccessManager;
+class QNetworkReply;
+class ModelhubWrapper;
+
+// 一个批次的向量化结果，count个dim维向量连续存放
+struct EmbeddingResult {
+    std::vector<float> data;
+    int count = 0;
+    int dim = 0;
+
+    inline bool isValid() const { return count > 0 && dim > 0; }
+    inline const float *vector(int i) const { return data.data() + static_cast<size_t>(i) * dim; }
+};
+
+// 常驻的向量化客户端：复用连接，多个批次同时在途，结果通过QFuture取回
+class EmbeddingClient : public QObject
+{
+    Q_OBJECT
+    friend class tst_EmbeddingClient;
+public:
+    // 一个批次：indexes为批内文本在输入中的位置
+    struct Batch {
+        QVector<int> indexes;
+        QFuture<EmbeddingResult> reply;
+    };
+
+    explicit EmbeddingClient(ModelhubWrapper *model);
+    ~EmbeddingClient();
+
+    // 提交一批文本并立即返回；在途批次达到上限时阻塞调用线程。batchSize为分批时的批次大小，用于调整采样
+    QFuture<EmbeddingResult> post(const QStringList &texts, int batchSize = 0);
+    // 按长度相近分组、按当前批次大小分批提交
+    QList<Batch> embed(const QStringList &texts);
+    // 检索问题向量化，结果按问题缓存，所有使用该模型的应用共享
+    bool embedQuery(const QString &query, QVector<float> &vector);
+
+    QString modelName() const;
+    int batchSize() const;
+    QJsonObject diagnostics() const;
+
+    static QFuture<EmbeddingResult> emptyResult();
+
+private:
+    struct Request {
+        QFutureInterface<EmbeddingResult> promise;
+        QStringList texts;
+        int count = 0;
+        bool base64 = false;
+        bool priority = false;   // 检索问题，不占用在途名额
+        int batchSize = 0;       // 分批时的批次大小
+        QElapsedTimer timer;
+    };
+
+    struct QueryEntry {
+        QVector<float> vector;
+        qint64 time = 0;   // 写入时间(毫秒)
+    };
+
+    // 检索问题单独提交，不等待建索引的在途批次
+    QFuture<EmbeddingResult> postQuery(const QString &query);
+    QFuture<EmbeddingResult> send(const QStringList &texts, bool priority, int batchSize);
+    void doPost(Request req);
+    void onReplyFinished(QNetworkReply *reply);
+    void adjustBatchSize(const Request &req, qint64 latency, bool ok);
+    void shutdown();
+    static bool parseReply(const QByteArray &body, EmbeddingResult &result);
+
+private:
+    ModelhubWrapper *model = nullptr;
+    QNetworkAccessManager *manager = nullptr;
+    QHash<QNetworkReply *, Request> pending;
+    QSemaphore inFlight;
+    QThread workThread;
+    // 服务端不接受encoding_format时退回JSON数组，仅在工作线程中访问
+    bool useBase64 = true;
+
+    // 自适应批次大小，按实测吞吐爬山调整
+    mutable QMutex statsMtx;
+    int currentBatchSize;
+    int direction = 1;
+    int windowSamples = 0;
+    qint64 windowChunks = 0;
+    double windowThroughput = 0;   // 各批次吞吐按块数加权的和
+    double lastThroughput = 0;
+    double avgLatency = 0;
+    qint64 requests = 0;
+    qint64 failures = 0;
+    qint64 chunks = 0;
+    qint64 busyTime = 0;
+    QElapsedTimer busyTimer;
+
+    // 检索问题 -> 向量，按最近使用淘汰，超过有效期的不再使用
+    mutable QMutex queryMtx;
+    QCache<QString, QueryEntry> queryCache;
+    qint64 queryHits = 0;
+    qint64 queryMisses = 0;
+};
+
+#endif // EMBEDDINGCLIENT_H
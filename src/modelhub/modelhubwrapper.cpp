@@ -15,14 +15,25 @@
 #include <QEventLoop>
 #include <QFileInfo>
 #include <QProcess>
+#include <QDateTime>
+#include <QTimer>
 
 #include <unistd.h>
 
+// 健康状态的有效期与后台刷新间隔(毫秒)
+static constexpr qint64 kHealthTTL = 15 * 1000;
+static constexpr int kHealthRefreshInterval = 5 * 1000;
+static constexpr int kHealthProbeTimeout = 3 * 1000;
+
 ModelhubWrapper::ModelhubWrapper(const QString &model, QObject *parent)
     : QObject(parent)
     , modelName(model)
 {
     Q_ASSERT(!model.isEmpty());
+
+    healthTimer.setInterval(kHealthRefreshInterval);
+    connect(&healthTimer, &QTimer::timeout, this, &ModelhubWrapper::refreshHealth);
+    healthTimer.start();
 }
 
 ModelhubWrapper::~ModelhubWrapper()
@@ -49,15 +60,20 @@ bool ModelhubWrapper::isRunning()
 
 bool ModelhubWrapper::ensureRunning()
 {
-    if (health())
+    lastUsed.storeRelease(QDateTime::currentMSecsSinceEpoch());
+
+    // 有效期内不再请求/health
+    if (isHealthCached() || health())
         return true;
 
     // check running by user
     QWriteLocker lk(&lock);
     {
         updateHost();
-        if (!host.isEmpty() && port > 0)
+        if (!host.isEmpty() && port > 0) {
+            markHealthy();
             return true;
+        }
     }
 
     const int idle = 180;
@@ -91,6 +107,7 @@ bool ModelhubWrapper::ensureRunning()
             updateHost();
             if (!host.isEmpty() && port > 0) {
                 qInfo() << modelName << process.pid() << "get server host" << host << port;
+                markHealthy();
                 return true;
             }
         }
@@ -119,7 +136,55 @@ bool ModelhubWrapper::health()
     QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
     loop.exec();
     reply->deleteLater();
-    return reply->error() == QNetworkReply::NoError;
+
+    bool ok = reply->error() == QNetworkReply::NoError;
+    if (ok)
+        markHealthy();
+    else
+        invalidate();
+    return ok;
+}
+
+void ModelhubWrapper::invalidate()
+{
+    healthTime.storeRelease(0);
+}
+
+bool ModelhubWrapper::isHealthCached() const
+{
+    const qint64 time = healthTime.loadAcquire();
+    return time > 0 && QDateTime::currentMSecsSinceEpoch() - time < kHealthTTL;
+}
+
+void ModelhubWrapper::markHealthy()
+{
+    healthTime.storeRelease(QDateTime::currentMSecsSinceEpoch());
+}
+
+void ModelhubWrapper::refreshHealth()
+{
+    // 最近未使用时不探测，缓存自然过期，不影响服务空闲退出
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (probing || !isHealthCached() || now - lastUsed.loadAcquire() > kHealthTTL)
+        return;
+
+    if (!probeManager)
+        probeManager = new QNetworkAccessManager(this);
+
+    QNetworkReply *reply = probeManager->get(QNetworkRequest(QUrl(urlPath("/health"))));
+    if (!reply)
+        return;
+
+    probing = true;
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+        probing = false;
+        if (reply->error() == QNetworkReply::NoError)
+            markHealthy();
+        else
+            invalidate();
+        reply->deleteLater();
+    });
+    QTimer::singleShot(kHealthProbeTimeout, reply, &QNetworkReply::abort);
 }
 
 QString ModelhubWrapper::urlPath(const QString &api) const
@@ -6,6 +6,10 @@
 
 #include <QObject>
 #include <QReadWriteLock>
+#include <QAtomicInteger>
+#include <QTimer>
+
+class QNetworkAccessManager;
 
 class ModelhubWrapper : public QObject
 {
@@ -16,13 +20,20 @@ public:
     bool isRunning();
     bool ensureRunning();
     bool health();
+    // 连接出错时调用，下次ensureRunning重新检查服务状态
+    void invalidate();
     QString urlPath(const QString &api) const;
+    inline QString model() const { return modelName; }
     static bool isModelhubInstalled();
     static bool isModelInstalled(const QString &model);
     static QVariantHash modelStatus(const QString &model);
     static bool openCmd(const QString &cmd, QString &out);
 protected:
     void updateHost();
+    bool isHealthCached() const;
+    void markHealthy();
+protected Q_SLOTS:
+    void refreshHealth();
 protected:
     QString modelName;
     QString host;
@@ -30,5 +41,12 @@ protected:
     bool started = false;
     qint64 pid = -1;
     mutable QReadWriteLock lock;
+
+    // 服务健康状态缓存，最近使用期间由定时器在后台刷新
+    QAtomicInteger<qint64> healthTime = 0;   // 最近一次确认健康的时间(毫秒)，0为无效
+    QAtomicInteger<qint64> lastUsed = 0;
+    QTimer healthTimer;
+    QNetworkAccessManager *probeManager = nullptr;
+    bool probing = false;
 };
 #endif   // MODELHUBWRAPPER_H
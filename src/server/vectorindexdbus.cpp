@@ -10,11 +10,7 @@
 #include <QDebug>
 #include <QThread>
 #include <QDBusConnection>
-#include <QEventLoop>
-#include <QNetworkAccessManager>
-#include <QNetworkReply>
 #include <QJsonObject>
-#include <QJsonArray>
 #include <QJsonDocument>
 #include <QDir>
 
@@ -32,6 +28,9 @@ VectorIndexDBus::~VectorIndexDBus()
         delete it;
         it = nullptr;
     }
+
+    delete embeddingClient;
+    embeddingClient = nullptr;
 }
 
 bool VectorIndexDBus::Create(const QString &appID, const QStringList &files)
@@ -73,6 +72,15 @@ QString VectorIndexDBus::DocFiles(const QString &appID)
     return embeddingWorker->getDocFile();
 }
 
+QString VectorIndexDBus::Diagnostics(const QString &appID)
+{
+    EmbeddingWorker *embeddingWorker = ensureWorker(appID);
+    if (!embeddingWorker)
+        return {};
+
+    return embeddingWorker->getDiagnostics();
+}
+
 QString VectorIndexDBus::Search(const QString &appID, const QString &query, int topK)
 {
     EmbeddingWorker *embeddingWorker = ensureWorker(appID);
@@ -82,6 +90,16 @@ QString VectorIndexDBus::Search(const QString &appID, const QString &query, int
     return embeddingWorker->doVectorSearch(query, topK);;
 }
 
+QString VectorIndexDBus::SearchSnippet(const QString &appID, const QString &query, int topK, int snippetLength)
+{
+    EmbeddingWorker *embeddingWorker = ensureWorker(appID);
+    if (!embeddingWorker)
+        return "";
+
+    // 只返回摘要与位置，完整内容由调用方按startIndex/length从原文获取
+    return embeddingWorker->doVectorSearch(query, topK, qMax(1, snippetLength));
+}
+
 QString VectorIndexDBus::getAutoIndexStatus(const QString &appID)
 {
     EmbeddingWorker *embeddingWorker = ensureWorker(appID);
@@ -149,50 +167,6 @@ EmbeddingWorker *VectorIndexDBus::ensureWorker(const QString &appID)
     return worker;
 }
 
-QJsonObject VectorIndexDBus::embeddingApi(const QStringList &texts, void *user)
-{
-    VectorIndexDBus *self = static_cast<VectorIndexDBus *>(user);
-    if (!self->bgeModel->ensureRunning()) {
-        return {};
-    }
-
-    QNetworkAccessManager manager;
-    QNetworkRequest request(self->bgeModel->urlPath("/embeddings"));
-    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-
-    QJsonArray jsonArray;
-    for (const QString &str : texts) {
-        jsonArray.append(str);
-    }
-    QJsonValue jsonValue = QJsonValue(jsonArray);
-
-    QJsonObject data;
-    data["input"] = jsonValue;
-
-    QJsonDocument jsonDocHttp(data);
-    QByteArray jsonDataHttp = jsonDocHttp.toJson();
-    QJsonDocument replyJson;
-    QNetworkReply *reply = manager.post(request, jsonDataHttp);
-
-    QEventLoop loop;
-    QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-    loop.exec();
-    if (reply->error() == QNetworkReply::NoError) {
-        QByteArray response = reply->readAll();
-        replyJson = QJsonDocument::fromJson(response);
-        qDebug() << "Response ok";
-    } else {
-        qDebug() << "Failed to create data:" << reply->errorString();
-    }
-    reply->deleteLater();
-    QJsonObject obj = {};
-    if (replyJson.isObject()) {
-        obj = replyJson.object();
-        return obj;
-    }
-    return {};
-}
-
 void VectorIndexDBus::initBgeModel()
 {
     QTimer::singleShot(100, this, [](){
@@ -205,6 +179,7 @@ void VectorIndexDBus::initBgeModel()
     });
 
     bgeModel = new ModelhubWrapper(dependModel(), this);
+    embeddingClient = new EmbeddingClient(bgeModel);
 }
 
 void VectorIndexDBus::init()
@@ -225,7 +200,8 @@ void VectorIndexDBus::initEmbeddingWorker(EmbeddingWorker *ew)
     if (!ew)
         return;
 
-    ew->setEmbeddingApi(embeddingApi, this);
+    ew->setEmbeddingClient(embeddingClient);
     connect(ew, &EmbeddingWorker::statusChanged, this, &VectorIndexDBus::IndexStatus);
     connect(ew, &EmbeddingWorker::indexDeleted, this, &VectorIndexDBus::IndexDeleted);
+    connect(ew, &EmbeddingWorker::indexProgress, this, &VectorIndexDBus::IndexProgress);
 }
@@ -7,6 +7,7 @@
 
 #include "index/embeddingworker.h"
 #include "modelhub/modelhubwrapper.h"
+#include "modelhub/embeddingclient.h"
 
 #include <QObject>
 #include <QDBusMessage>
@@ -29,9 +30,11 @@ public Q_SLOTS:
     bool Create(const QString &appID, const QStringList &files);
     bool Delete(const QString &appID, const QStringList &files);
     QString Search(const QString &appID, const QString &query, int topK);
+    QString SearchSnippet(const QString &appID, const QString &query, int topK, int snippetLength);
 
     bool Enable();
     QString DocFiles(const QString &appID);
+    QString Diagnostics(const QString &appID);
 
     QString getAutoIndexStatus(const QString &appID);
     void setAutoIndex(const QString &appID, bool on);
@@ -43,14 +46,14 @@ public Q_SLOTS:
 signals:
     void IndexStatus(const QString &appID, const QStringList &files, int status);
     void IndexDeleted(const QString &appID, const QStringList &files);
+    void IndexProgress(const QString &appID, int finished, int total);
 
 private:
     EmbeddingWorker *ensureWorker(const QString &appID);
-protected:
-    static QJsonObject embeddingApi(const QStringList &texts, void *user);
 
 private:
     ModelhubWrapper *bgeModel = nullptr;
+    EmbeddingClient *embeddingClient = nullptr;
     QMap<QString, EmbeddingWorker*> embeddingWorkerwManager;
     QList<QString> m_whiteList;
 
@@ -0,0 +1,104 @@
+// SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "dirjournal.h"
+
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QDebug>
+
+static constexpr quint32 kJournalMagic = 0x444a524e;   // "DJRN"
+static constexpr quint32 kJournalVersion = 1;
+
+DirJournal::DirJournal(const QString &file)
+    : journalFile(file)
+{
+}
+
+bool DirJournal::load()
+{
+    records.clear();
+
+    QFile file(journalFile);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QDataStream in(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 count = 0;
+    in >> magic >> version >> count;
+    if (magic != kJournalMagic || version != kJournalVersion) {
+        qWarning() << "invalid dir journal" << journalFile;
+        return false;
+    }
+
+    records.reserve(count);
+    QByteArray path;
+    QByteArray name;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        Record rec;
+        quint32 children = 0;
+        in >> path >> rec.inode >> rec.mtime >> rec.ctime >> children;
+
+        rec.children.reserve(children);
+        for (quint32 j = 0; j < children && in.status() == QDataStream::Ok; ++j) {
+            quint8 type = 0;
+            in >> name >> type;
+            rec.children.emplace_back(name.toStdString(), type);
+        }
+        records.emplace(path.toStdString(), std::move(rec));
+    }
+
+    // 文件不完整时整体丢弃，按全量遍历处理
+    if (in.status() != QDataStream::Ok) {
+        qWarning() << "dir journal is truncated" << journalFile;
+        records.clear();
+        return false;
+    }
+
+    qInfo() << "load dir journal:" << records.size() << "spending:" << timer.elapsed();
+    return true;
+}
+
+bool DirJournal::save() const
+{
+    QSaveFile file(journalFile);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "can not write dir journal" << journalFile;
+        return false;
+    }
+
+    QDataStream out(&file);
+    out << kJournalMagic << kJournalVersion << static_cast<quint32>(records.size());
+    for (const auto &it : records) {
+        const Record &rec = it.second;
+        out << QByteArray::fromStdString(it.first) << rec.inode << rec.mtime << rec.ctime
+            << static_cast<quint32>(rec.children.size());
+        for (const auto &child : rec.children)
+            out << QByteArray::fromStdString(child.first) << static_cast<quint8>(child.second);
+    }
+
+    if (out.status() != QDataStream::Ok) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+const DirJournal::Record *DirJournal::find(const std::string &dir) const
+{
+    auto it = records.find(dir);
+    return it == records.end() ? nullptr : &it->second;
+}
+
+void DirJournal::reset(DirJournal::Records &&newRecords)
+{
+    records = std::move(newRecords);
+}
@@ -0,0 +1,44 @@
+// SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef DIRJOURNAL_H
+#define DIRJOURNAL_H
+
+#include <QString>
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// 上次遍历时各目录的inode、mtime与子项列表。目录的mtime只在增删、重命名子项时变化，
+// 未变化的目录可直接使用记录的子项，不必重新读取目录
+class DirJournal
+{
+public:
+    struct Record {
+        quint64 inode = 0;
+        qint64 mtime = 0;      // 纳秒
+        qint64 ctime = 0;      // 纳秒，mtime被回设时仍能发现变化
+        std::vector<std::pair<std::string, unsigned char>> children;   // 子项名与d_type
+    };
+    using Records = std::unordered_map<std::string, Record>;
+
+    explicit DirJournal(const QString &file);
+
+    bool load();
+    bool save() const;
+
+    const Record *find(const std::string &dir) const;
+    // 以本次遍历的结果替换，未再遍历到的目录随之移除
+    void reset(Records &&records);
+
+    inline size_t size() const { return records.size(); }
+
+private:
+    QString journalFile;
+    Records records;
+};
+
+#endif // DIRJOURNAL_H
@@ -0,0 +1,351 @@
+// SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "filecrawler.h"
+
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+#include <QDebug>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <ctime>
+
+// 没有可处理的目录时，空闲线程等待新目录的最长时间(毫秒)
+static constexpr unsigned long kIdleWait = 5;
+
+// 所有遍历共用的线程池，线程数不超过CPU核数，空闲的线程按默认超时退出
+Q_GLOBAL_STATIC(QThreadPool, crawlerPool)
+
+static inline qint64 nanoseconds(const struct timespec &ts)
+{
+    return static_cast<qint64>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+FileCrawler::FileCrawler(const Options &options)
+    : opts(options)
+{
+    if (opts.queueSize < 1)
+        opts.queueSize = 1;
+
+    for (const QString &prefix : opts.blacklist) {
+        if (!prefix.isEmpty())
+            blacklist.push_back(prefix.toStdString());
+    }
+}
+
+FileCrawler::~FileCrawler()
+{
+    cancel();
+
+    // 线程池被其他遍历占满时，本次的工作线程可能尚未开始，需等到全部退出
+    QMutexLocker lk(&outMtx);
+    while (runningWorkers > 0)
+        notEmpty.wait(&outMtx);
+}
+
+void FileCrawler::start(const QString &root)
+{
+    Q_ASSERT(!started);
+    started = true;
+    startTime = time(nullptr);
+
+    std::string path = root.toStdString();
+    while (path.size() > 1 && path.back() == '/')
+        path.pop_back();
+
+    struct stat st;
+    if (path.empty() || isFiltered(path) || stat(path.c_str(), &st) != 0)
+        return;
+
+    if (!S_ISDIR(st.st_mode)) {
+        emitEntry(path, &st);
+        return;
+    }
+
+    if (opts.maxDepth == 0)
+        return;
+
+    // 工作线程数不超过线程池上限，排队等待的线程会在其他遍历让出线程后执行
+    const int limit = crawlerPool->maxThreadCount();
+    const int threads = qMax(1, opts.threads > 0 ? qMin(opts.threads, limit) : limit);
+    for (int i = 0; i < threads; ++i)
+        queues.emplace_back(new WorkQueue);
+
+    pendingDirs = 1;
+    queues.front()->dirs.push_back({ path, 1, nullptr });
+
+    {
+        QMutexLocker lk(&outMtx);
+        runningWorkers = threads;
+    }
+
+    for (int i = 0; i < threads; ++i)
+        QtConcurrent::run(crawlerPool, [this, i]() { run(i); });
+}
+
+bool FileCrawler::next(Entry &entry)
+{
+    QMutexLocker lk(&outMtx);
+    while (out.empty() && runningWorkers > 0 && !cancelled)
+        notEmpty.wait(&outMtx);
+
+    if (out.empty() || cancelled)
+        return false;
+
+    entry = std::move(out.front());
+    out.pop_front();
+    notFull.wakeOne();
+    return true;
+}
+
+void FileCrawler::cancel()
+{
+    cancelled = true;
+
+    {
+        QMutexLocker lk(&outMtx);
+        notFull.wakeAll();
+        notEmpty.wakeAll();
+    }
+
+    QMutexLocker lk(&idleMtx);
+    idleCond.wakeAll();
+}
+
+void FileCrawler::run(int index)
+{
+    DirTask task;
+    while (!cancelled) {
+        if (takeTask(index, task)) {
+            crawlDir(index, task);
+            if (--pendingDirs == 0) {
+                QMutexLocker lk(&idleMtx);
+                idleCond.wakeAll();
+            }
+            continue;
+        }
+
+        // 其他线程处理中的目录还可能产生新目录
+        QMutexLocker lk(&idleMtx);
+        if (pendingDirs == 0)
+            break;
+        idleCond.wait(&idleMtx, kIdleWait);
+    }
+
+    QMutexLocker lk(&outMtx);
+    if (--runningWorkers == 0) {
+        // 未取消即已遍历完整棵树
+        if (!cancelled)
+            updateJournal();
+        notEmpty.wakeAll();
+    }
+}
+
+bool FileCrawler::takeTask(int index, DirTask &task)
+{
+    // 自己的队列后进先出，保持深度优先的局部性
+    {
+        WorkQueue *own = queues.at(static_cast<size_t>(index)).get();
+        QMutexLocker lk(&own->mtx);
+        if (!own->dirs.empty()) {
+            task = std::move(own->dirs.back());
+            own->dirs.pop_back();
+            return true;
+        }
+    }
+
+    // 从其他线程队列的头部窃取，拿到的多是较大的子树
+    const int count = static_cast<int>(queues.size());
+    for (int i = 1; i < count; ++i) {
+        WorkQueue *other = queues.at(static_cast<size_t>((index + i) % count)).get();
+        QMutexLocker lk(&other->mtx);
+        if (!other->dirs.empty()) {
+            task = std::move(other->dirs.front());
+            other->dirs.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void FileCrawler::pushTask(int index, DirTask task)
+{
+    ++pendingDirs;
+    {
+        WorkQueue *own = queues.at(static_cast<size_t>(index)).get();
+        QMutexLocker lk(&own->mtx);
+        own->dirs.push_back(std::move(task));
+    }
+    idleCond.wakeOne();
+}
+
+void FileCrawler::crawlDir(int index, const DirTask &task)
+{
+    int fd = open(task.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    // 读取子项前取目录状态，读取期间的变更会体现在下次遍历的mtime上
+    struct stat dirSt;
+    if (fstat(fd, &dirSt) != 0) {
+        close(fd);
+        return;
+    }
+
+    // 经符号链接回到自身的祖先目录时不再进入
+    for (const DirNode *up = task.parent.get(); up; up = up->parent.get()) {
+        if (up->dev == dirSt.st_dev && up->ino == dirSt.st_ino) {
+            close(fd);
+            return;
+        }
+    }
+    const auto node = std::make_shared<const DirNode>(DirNode { dirSt.st_dev, dirSt.st_ino, task.parent });
+
+    const std::string prefix = task.path == "/" ? task.path : task.path + '/';
+    const qint64 mtime = nanoseconds(dirSt.st_mtim);
+    const qint64 ctime = nanoseconds(dirSt.st_ctim);
+    const DirJournal::Record *old = opts.journal ? opts.journal->find(task.path) : nullptr;
+
+    DirJournal::Record record;
+    bool complete = true;
+    if (old && old->inode == dirSt.st_ino && old->mtime == mtime && old->ctime == ctime) {
+        // 目录未变化，沿用记录的子项，只对其中的文件fstatat
+        ++reusedDirs;
+        for (const auto &child : old->children) {
+            if (cancelled || !crawlEntry(index, fd, task, node, prefix, child.first.c_str(), child.second)) {
+                complete = false;
+                break;
+            }
+        }
+        close(fd);
+        if (complete)
+            record.children = old->children;
+    } else {
+        DIR *dir = fdopendir(fd);
+        if (!dir) {
+            qWarning() << "can not open: " << task.path.c_str();
+            close(fd);
+            return;
+        }
+
+        struct dirent *dent = nullptr;
+        errno = 0;
+        while (!cancelled && (dent = readdir(dir))) {
+            const char *name = dent->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            // 记录过滤前的全部子项，黑名单等配置变化后记录仍然可用
+            if (opts.journal)
+                record.children.emplace_back(name, dent->d_type);
+
+            if (!crawlEntry(index, fd, task, node, prefix, name, dent->d_type)) {
+                complete = false;
+                break;
+            }
+            errno = 0;
+        }
+
+        if (errno != 0 || cancelled)
+            complete = false;
+
+        // 同时关闭fd
+        closedir(dir);
+    }
+
+    // 与本次遍历开始时间过近的目录不记录，避免同一时间粒度内的后续变更被漏掉
+    if (opts.journal && complete && dirSt.st_mtime < startTime - 1 && dirSt.st_ctime < startTime - 1) {
+        record.inode = dirSt.st_ino;
+        record.mtime = mtime;
+        record.ctime = ctime;
+        queues.at(static_cast<size_t>(index))->records.emplace(task.path, std::move(record));
+    }
+}
+
+bool FileCrawler::crawlEntry(int index, int fd, const DirTask &task, const std::shared_ptr<const DirNode> &node,
+                             const std::string &prefix, const char *name, unsigned char type)
+{
+    if (opts.skipHidden && name[0] == '.')
+        return true;
+
+    std::string path = prefix + name;
+    if (isFiltered(path))
+        return true;
+
+    // 优先使用d_type，文件系统不提供时或为符号链接时才fstatat。
+    // 与stat()一致跟随符号链接，失效的链接跳过，链接的目录由crawlDir检查循环
+    struct stat st;
+    bool hasStat = false;
+    if (type == DT_UNKNOWN || type == DT_LNK) {
+        if (fstatat(fd, name, &st, 0) != 0)
+            return true;
+        hasStat = true;
+        type = S_ISDIR(st.st_mode) ? DT_DIR : DT_UNKNOWN;
+    }
+
+    if (type == DT_DIR) {
+        if (opts.maxDepth < 0 || task.depth < opts.maxDepth)
+            pushTask(index, { std::move(path), task.depth + 1, node });
+        return true;
+    }
+
+    if (opts.maxDepth >= 0 && task.depth > opts.maxDepth)
+        return true;
+
+    // 目录以外的类型都交给调用方
+    if (opts.statFiles && !hasStat) {
+        if (fstatat(fd, name, &st, 0) != 0)
+            return true;
+        hasStat = true;
+    }
+
+    return emitEntry(path, hasStat ? &st : nullptr);
+}
+
+void FileCrawler::updateJournal()
+{
+    if (!opts.journal || queues.empty())
+        return;
+
+    DirJournal::Records records = std::move(queues.front()->records);
+    for (size_t i = 1; i < queues.size(); ++i) {
+        for (auto &it : queues.at(i)->records)
+            records.emplace(it.first, std::move(it.second));
+        queues.at(i)->records.clear();
+    }
+    opts.journal->reset(std::move(records));
+}
+
+bool FileCrawler::emitEntry(const std::string &path, const struct stat *st)
+{
+    Entry entry;
+    entry.path = QString::fromUtf8(path.data(), static_cast<int>(path.size()));
+    if (st)
+        entry.st = *st;
+
+    QMutexLocker lk(&outMtx);
+    while (static_cast<int>(out.size()) >= opts.queueSize && !cancelled)
+        notFull.wait(&outMtx);
+
+    if (cancelled)
+        return false;
+
+    out.push_back(std::move(entry));
+    notEmpty.wakeOne();
+    return true;
+}
+
+bool FileCrawler::isFiltered(const std::string &path) const
+{
+    for (const std::string &prefix : blacklist) {
+        if (path.compare(0, prefix.size(), prefix) == 0)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,107 @@
+// SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef FILECRAWLER_H
+#define FILECRAWLER_H
+
+#include "dirjournal.h"
+
+#include <QString>
+#include <QStringList>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+// 并行遍历目录树：各线程优先处理自己队列中的目录，空闲时从其他线程的队列窃取，
+// 遍历到的文件经有界队列交给调用方。按d_type判断类型，只对需要的文件fstatat。
+// 工作线程来自进程内共享的线程池，同时进行的多次遍历不会各自创建一组线程
+class FileCrawler
+{
+public:
+    struct Options {
+        QStringList blacklist;     // 路径前缀，命中的目录与文件不遍历
+        bool skipHidden = true;    // 跳过以'.'开头的文件与目录
+        bool statFiles = true;     // 为文件填充stat信息
+        int maxDepth = -1;         // 文件相对起点的最大层数，< 0 不限制
+        int threads = 0;           // <= 0 或超过共享线程池上限时取线程池上限
+        int queueSize = 4096;      // 未被取走的文件数上限
+        DirJournal *journal = nullptr;  // 非空时未变化的目录沿用记录的子项，完整遍历后更新
+    };
+
+    struct Entry {
+        QString path;
+        struct stat st {};         // statFiles为false时无效
+    };
+
+    explicit FileCrawler(const Options &options);
+    ~FileCrawler();
+
+    // 起点为文件时只返回该文件
+    void start(const QString &root);
+    // 取下一个文件，阻塞等待；遍历结束或已取消时返回false。
+    // 工作线程在队列满时等待取走，不能在共享线程池的线程中调用
+    bool next(Entry &entry);
+    void cancel();
+
+    // 沿用记录、未重新读取的目录数
+    inline int reusedDirCount() const { return reusedDirs; }
+
+private:
+    Q_DISABLE_COPY(FileCrawler)
+
+    // 目录及其祖先的(dev, inode)，跟随符号链接进入目录时据此发现循环
+    struct DirNode {
+        dev_t dev;
+        ino_t ino;
+        std::shared_ptr<const DirNode> parent;
+    };
+
+    struct DirTask {
+        std::string path;
+        int depth;         // 目录中文件的层数
+        std::shared_ptr<const DirNode> parent;
+    };
+
+    struct WorkQueue {
+        QMutex mtx;
+        std::deque<DirTask> dirs;
+        DirJournal::Records records;    // 只由所属线程写入
+    };
+
+    void run(int index);
+    bool takeTask(int index, DirTask &task);
+    void pushTask(int index, DirTask task);
+    void crawlDir(int index, const DirTask &task);
+    bool crawlEntry(int index, int fd, const DirTask &task, const std::shared_ptr<const DirNode> &node,
+                    const std::string &prefix, const char *name, unsigned char type);
+    void updateJournal();
+    bool emitEntry(const std::string &path, const struct stat *st);
+    bool isFiltered(const std::string &path) const;
+
+    Options opts;
+    std::vector<std::string> blacklist;     // UTF-8的路径前缀
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::atomic<int> pendingDirs { 0 };      // 已入队或正在处理的目录数
+    std::atomic<bool> cancelled { false };
+    std::atomic<int> reusedDirs { 0 };
+    time_t startTime = 0;
+    QMutex idleMtx;
+    QWaitCondition idleCond;
+
+    QMutex outMtx;
+    QWaitCondition notEmpty;
+    QWaitCondition notFull;
+    std::deque<Entry> out;
+    int runningWorkers = 0;
+    bool started = false;
+};
+
+#endif // FILECRAWLER_H
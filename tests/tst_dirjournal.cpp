@@ -0,0 +1,224 @@
+// SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "utils/dirjournal.h"
+#include "utils/filecrawler.h"
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include <dirent.h>
+#include <unistd.h>
+
+static QSet<QString> crawl(const QString &root, DirJournal *journal, int *reused = nullptr)
+{
+    FileCrawler::Options opts;
+    opts.journal = journal;
+    FileCrawler crawler(opts);
+    crawler.start(root);
+
+    QSet<QString> files;
+    FileCrawler::Entry entry;
+    while (crawler.next(entry))
+        files << entry.path;
+
+    if (reused)
+        *reused = crawler.reusedDirCount();
+    return files;
+}
+
+static bool writeFile(const QString &path, const QByteArray &content = "x")
+{
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly) && file.write(content) == content.size();
+}
+
+class tst_DirJournal : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void saveAndLoad();
+    void loadRejectsDamagedFile();
+    void reuseUnchangedDirs();
+    void linkTargetChanged();
+    void recentDirsNotRecorded();
+    void cancelledCrawlKeepsJournal();
+
+private:
+    QString path(const QString &name) const { return root.path() + '/' + name; }
+    std::string key(const QString &name) const { return path(name).toStdString(); }
+    QString journalFile(const QString &name) const { return store.path() + '/' + name; }
+
+    QTemporaryDir root;
+    QTemporaryDir outside;
+    QTemporaryDir store;    // 日志文件不放在被遍历的目录中
+    QSet<QString> expected;
+};
+
+void tst_DirJournal::initTestCase()
+{
+    QVERIFY(root.isValid());
+    QVERIFY(outside.isValid());
+    QVERIFY(store.isValid());
+
+    QVERIFY(QDir(root.path()).mkpath("d1/d2"));
+    QVERIFY(writeFile(path("a.txt")));
+    QVERIFY(writeFile(path("d1/b.txt")));
+    QVERIFY(writeFile(path("d1/d2/c.txt")));
+    QVERIFY(writeFile(outside.path() + "/o.txt"));
+    QCOMPARE(symlink(outside.path().toUtf8().constData(), path("d1/lnk").toUtf8().constData()), 0);
+
+    expected = { path("a.txt"), path("d1/b.txt"), path("d1/d2/c.txt"), path("d1/lnk/o.txt") };
+
+    // 与遍历开始时间相差不足1秒的目录不记录，等目录"变旧"后再遍历
+    QTest::qSleep(2100);
+}
+
+void tst_DirJournal::saveAndLoad()
+{
+    DirJournal::Record rec;
+    rec.inode = 42;
+    rec.mtime = 1700000000123456789;
+    rec.ctime = 1700000001987654321;
+    rec.children = { { "a.txt", DT_REG }, { "子目录", DT_DIR }, { "lnk", DT_LNK } };
+
+    DirJournal::Records records;
+    records.emplace("/x", rec);
+    records.emplace("/x/子目录", DirJournal::Record());
+
+    DirJournal journal(journalFile("roundtrip"));
+    journal.reset(std::move(records));
+    QVERIFY(journal.save());
+
+    DirJournal loaded(journalFile("roundtrip"));
+    QVERIFY(loaded.load());
+    QCOMPARE(loaded.size(), size_t(2));
+
+    const DirJournal::Record *found = loaded.find("/x");
+    QVERIFY(found);
+    QCOMPARE(found->inode, rec.inode);
+    QCOMPARE(found->mtime, rec.mtime);
+    QCOMPARE(found->ctime, rec.ctime);
+    QVERIFY(found->children == rec.children);
+
+    found = loaded.find("/x/子目录");
+    QVERIFY(found);
+    QVERIFY(found->children.empty());
+    QVERIFY(!loaded.find("/y"));
+}
+
+void tst_DirJournal::loadRejectsDamagedFile()
+{
+    DirJournal missing(journalFile("missing"));
+    QVERIFY(!missing.load());
+
+    QVERIFY(writeFile(journalFile("garbage"), "not a journal"));
+    DirJournal garbage(journalFile("garbage"));
+    QVERIFY(!garbage.load());
+    QCOMPARE(garbage.size(), size_t(0));
+
+    // 不完整的文件整体丢弃
+    DirJournal::Records records;
+    DirJournal::Record rec;
+    rec.children = { { "a.txt", DT_REG }, { "b.txt", DT_REG } };
+    records.emplace("/x", rec);
+    records.emplace("/y", rec);
+    DirJournal journal(journalFile("full"));
+    journal.reset(std::move(records));
+    QVERIFY(journal.save());
+
+    QFile full(journalFile("full"));
+    QVERIFY(full.open(QIODevice::ReadOnly));
+    QByteArray data = full.readAll();
+    data.chop(3);
+    QVERIFY(writeFile(journalFile("truncated"), data));
+
+    DirJournal truncated(journalFile("truncated"));
+    QVERIFY(!truncated.load());
+    QCOMPARE(truncated.size(), size_t(0));
+}
+
+void tst_DirJournal::reuseUnchangedDirs()
+{
+    DirJournal journal(journalFile("reuse"));
+    int reused = -1;
+    QCOMPARE(crawl(root.path(), &journal, &reused), expected);
+    QCOMPARE(reused, 0);
+    // 起点、d1、d2与链接进入的目录
+    QCOMPARE(journal.size(), size_t(4));
+    QVERIFY(journal.find(key("d1/lnk")));
+
+    QCOMPARE(crawl(root.path(), &journal, &reused), expected);
+    QCOMPARE(reused, 4);
+
+    QVERIFY(journal.save());
+    DirJournal loaded(journalFile("reuse"));
+    QVERIFY(loaded.load());
+    QCOMPARE(crawl(root.path(), &loaded, &reused), expected);
+    QCOMPARE(reused, 4);
+}
+
+void tst_DirJournal::linkTargetChanged()
+{
+    DirJournal journal(journalFile("link"));
+    crawl(root.path(), &journal);
+    QCOMPARE(journal.size(), size_t(4));
+
+    // 链接所在目录未变，链接目标目录的变化仍能发现
+    QVERIFY(writeFile(outside.path() + "/p.txt"));
+    expected << path("d1/lnk/p.txt");
+
+    int reused = -1;
+    QCOMPARE(crawl(root.path(), &journal, &reused), expected);
+    QCOMPARE(reused, 3);
+    QVERIFY(!journal.find(key("d1/lnk")));
+}
+
+void tst_DirJournal::recentDirsNotRecorded()
+{
+    DirJournal journal(journalFile("recent"));
+    crawl(root.path(), &journal);
+    QVERIFY(journal.find(root.path().toStdString()));
+
+    // 新建的目录及其父目录都在1秒内变化过
+    QVERIFY(QDir(root.path()).mkdir("d3"));
+    QVERIFY(writeFile(path("d3/new.txt")));
+    expected << path("d3/new.txt");
+
+    int reused = -1;
+    QCOMPARE(crawl(root.path(), &journal, &reused), expected);
+    QCOMPARE(reused, 2);
+    QVERIFY(!journal.find(root.path().toStdString()));
+    QVERIFY(!journal.find(key("d3")));
+    QVERIFY(journal.find(key("d1")));
+    QVERIFY(journal.find(key("d1/d2")));
+}
+
+void tst_DirJournal::cancelledCrawlKeepsJournal()
+{
+    DirJournal journal(journalFile("cancel"));
+    crawl(root.path(), &journal);
+    const size_t records = journal.size();
+    QVERIFY(records > 0);
+
+    {
+        FileCrawler::Options opts;
+        opts.journal = &journal;
+        opts.queueSize = 1;
+        FileCrawler crawler(opts);
+        crawler.start(root.path());
+
+        FileCrawler::Entry entry;
+        QVERIFY(crawler.next(entry));
+        crawler.cancel();
+    }
+
+    // 未遍历完整棵树，不替换已有记录
+    QCOMPARE(journal.size(), records);
+}
+
+QTEST_GUILESS_MAIN(tst_DirJournal)
+
+#include "tst_dirjournal.moc"
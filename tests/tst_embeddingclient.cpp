@@ -0,0 +1,158 @@
+// SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "modelhub/embeddingclient.h"
+
+#include <QtTest>
+#include <QtEndian>
+
+#include <cmath>
+#include <cstring>
+#include <random>
+
+// 按服务端的格式拼出应答，vectors为各条的"embedding"字段值
+static QByteArray replyBody(const QList<QByteArray> &vectors)
+{
+    QByteArray body("{\"object\": \"list\", \"data\": [");
+    for (int i = 0; i < vectors.size(); ++i) {
+        if (i > 0)
+            body += ", ";
+        body += "{\"object\": \"embedding\", \"embedding\": " + vectors.at(i)
+                + ", \"index\": " + QByteArray::number(i) + "}";
+    }
+    body += "], \"model\": \"test\", \"usage\": {\"prompt_tokens\": 1, \"total_tokens\": 1}}";
+    return body;
+}
+
+// 小端float32的base64字符串
+static QByteArray base64Vector(const QVector<float> &vec)
+{
+    QByteArray raw(vec.size() * static_cast<int>(sizeof(float)), Qt::Uninitialized);
+    for (int i = 0; i < vec.size(); ++i) {
+        quint32 bits = 0;
+        memcpy(&bits, &vec.at(i), sizeof(bits));
+        qToLittleEndian(bits, reinterpret_cast<uchar *>(raw.data()) + i * sizeof(float));
+    }
+    return '"' + raw.toBase64() + '"';
+}
+
+class tst_EmbeddingClient : public QObject
+{
+    Q_OBJECT
+private slots:
+    void parseJsonArrays();
+    void parseBase64();
+    void parseNumbers_data();
+    void parseNumbers();
+    void parseRandomNumbers();
+    void rejectInvalid_data();
+    void rejectInvalid();
+};
+
+void tst_EmbeddingClient::parseJsonArrays()
+{
+    const QByteArray body = replyBody({ "[0.5, -1.25e-2, 3]", "[\n  1,\n  2,\n  3\n]" });
+
+    EmbeddingResult result;
+    QVERIFY(EmbeddingClient::parseReply(body, result));
+    QCOMPARE(result.count, 2);
+    QCOMPARE(result.dim, 3);
+    QCOMPARE(result.vector(0)[0], 0.5f);
+    QCOMPARE(result.vector(0)[1], -0.0125f);
+    QCOMPARE(result.vector(0)[2], 3.0f);
+    QCOMPARE(result.vector(1)[0], 1.0f);
+    QCOMPARE(result.vector(1)[2], 3.0f);
+}
+
+void tst_EmbeddingClient::parseBase64()
+{
+    const QVector<float> first { 0.5f, -2.0f, 1e-3f, 3.4e38f };
+    const QVector<float> second { -0.0f, 1.0f, 7.25f, -1e-30f };
+    const QByteArray body = replyBody({ base64Vector(first), base64Vector(second) });
+
+    EmbeddingResult result;
+    QVERIFY(EmbeddingClient::parseReply(body, result));
+    QCOMPARE(result.count, 2);
+    QCOMPARE(result.dim, 4);
+    // 按位还原
+    QVERIFY(memcmp(result.vector(0), first.constData(), sizeof(float) * 4) == 0);
+    QVERIFY(memcmp(result.vector(1), second.constData(), sizeof(float) * 4) == 0);
+}
+
+void tst_EmbeddingClient::parseNumbers_data()
+{
+    QTest::addColumn<QByteArray>("text");
+    QTest::addColumn<float>("value");
+
+    QTest::newRow("integer") << QByteArray("42") << 42.0f;
+    QTest::newRow("negative zero") << QByteArray("-0") << -0.0f;
+    QTest::newRow("plus sign") << QByteArray("+1.5") << 1.5f;
+    QTest::newRow("leading zeros") << QByteArray("0.000123") << 0.000123f;
+    QTest::newRow("exponent") << QByteArray("1.5E+2") << 150.0f;
+    QTest::newRow("negative exponent") << QByteArray("-2e-3") << -0.002f;
+    QTest::newRow("long mantissa") << QByteArray("0.12345678901234567890123") << 0.12345678901234567890123f;
+    QTest::newRow("long integer") << QByteArray("123456789012345678901234") << 123456789012345678901234.0f;
+}
+
+void tst_EmbeddingClient::parseNumbers()
+{
+    QFETCH(QByteArray, text);
+    QFETCH(float, value);
+
+    EmbeddingResult result;
+    QVERIFY(EmbeddingClient::parseReply(replyBody({ "[" + text + "]" }), result));
+    QCOMPARE(result.dim, 1);
+    QCOMPARE(result.data.front(), value);
+    QCOMPARE(std::signbit(result.data.front()), std::signbit(value));
+}
+
+void tst_EmbeddingClient::parseRandomNumbers()
+{
+    // 与QByteArray::toFloat的结果对照，覆盖服务端常见的定点与科学计数写法
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> mantissa(-1, 1);
+    std::uniform_int_distribution<int> exponent(-12, 6);
+
+    QList<QByteArray> texts;
+    QByteArray vector("[");
+    for (int i = 0; i < 1024; ++i) {
+        const double v = mantissa(rng) * std::pow(10.0, exponent(rng));
+        const QByteArray text = QByteArray::number(v, i % 2 ? 'e' : 'g', 6 + i % 12);
+        texts << text;
+        vector += (i ? ", " : "") + text;
+    }
+    vector += "]";
+
+    EmbeddingResult result;
+    QVERIFY(EmbeddingClient::parseReply(replyBody({ vector }), result));
+    QCOMPARE(result.dim, texts.size());
+    for (int i = 0; i < texts.size(); ++i)
+        QCOMPARE(result.data.at(static_cast<size_t>(i)), texts.at(i).toFloat());
+}
+
+void tst_EmbeddingClient::rejectInvalid_data()
+{
+    QTest::addColumn<QByteArray>("body");
+
+    QTest::newRow("no embedding") << QByteArray("{\"data\": []}");
+    QTest::newRow("empty vector") << replyBody({ "[]" });
+    QTest::newRow("dimension mismatch") << replyBody({ "[1, 2, 3]", "[1, 2]" });
+    QTest::newRow("truncated array") << QByteArray("{\"embedding\": [1, 2");
+    QTest::newRow("not a number") << replyBody({ "[1, x]" });
+    QTest::newRow("null") << replyBody({ "null" });
+    QTest::newRow("unterminated base64") << QByteArray("{\"embedding\": \"AAAAAA");
+    QTest::newRow("base64 not float aligned") << replyBody({ "\"" + QByteArray(5, '\1').toBase64() + "\"" });
+}
+
+void tst_EmbeddingClient::rejectInvalid()
+{
+    QFETCH(QByteArray, body);
+
+    EmbeddingResult result;
+    QVERIFY(!EmbeddingClient::parseReply(body, result));
+}
+
+QTEST_GUILESS_MAIN(tst_EmbeddingClient)
+
+#include "tst_embeddingclient.moc"
@@ -0,0 +1,213 @@
+// SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "utils/filecrawler.h"
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+static QSet<QString> crawl(const QString &root, const FileCrawler::Options &opts = FileCrawler::Options())
+{
+    FileCrawler crawler(opts);
+    crawler.start(root);
+
+    QSet<QString> files;
+    FileCrawler::Entry entry;
+    while (crawler.next(entry))
+        files << entry.path;
+    return files;
+}
+
+class tst_FileCrawler : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void traverse();
+    void fileStat();
+    void maxDepth();
+    void blacklist();
+    void startOnFile();
+    void cancel();
+    void concurrentCrawls();
+    void destroyUnconsumed();
+
+private:
+    QString path(const QString &name) const { return root.path() + '/' + name; }
+    void makeFile(const QString &name, const QByteArray &content = "x");
+    void makeLink(const QString &target, const QString &name);
+
+    QTemporaryDir root;
+    QTemporaryDir outside;
+    QSet<QString> expected;
+};
+
+void tst_FileCrawler::makeFile(const QString &name, const QByteArray &content)
+{
+    QFile file(path(name));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(content);
+}
+
+void tst_FileCrawler::makeLink(const QString &target, const QString &name)
+{
+    QCOMPARE(symlink(target.toUtf8().constData(), path(name).toUtf8().constData()), 0);
+}
+
+void tst_FileCrawler::initTestCase()
+{
+    QVERIFY(root.isValid());
+    QVERIFY(outside.isValid());
+
+    QDir dir(root.path());
+    QVERIFY(dir.mkpath("d1/d2"));
+    QVERIFY(dir.mkpath(".hidden"));
+    QVERIFY(dir.mkpath("black"));
+
+    makeFile("a.txt", "hello");
+    makeFile(".h.txt");
+    makeFile(".hidden/h.txt");
+    makeFile("d1/b.txt");
+    makeFile("d1/d2/c.txt");
+    makeFile("black/x.txt");
+
+    // 指向祖先目录的链接形成循环
+    makeLink("../..", "d1/d2/up");
+    // 指向树外目录的链接照常进入
+    QFile out(outside.path() + "/o.txt");
+    QVERIFY(out.open(QIODevice::WriteOnly));
+    out.close();
+    makeLink(outside.path(), "link_out");
+    // 指向文件的链接按目标文件处理，失效的链接跳过
+    makeLink("a.txt", "filelink");
+    makeLink(path("none"), "dangling");
+    // 目录以外的类型都交给调用方
+    QCOMPARE(mkfifo(path("fifo").toUtf8().constData(), 0600), 0);
+
+    expected = { path("a.txt"), path("d1/b.txt"), path("d1/d2/c.txt"), path("black/x.txt"),
+                 path("link_out/o.txt"), path("filelink"), path("fifo") };
+}
+
+void tst_FileCrawler::traverse()
+{
+    QCOMPARE(crawl(root.path()), expected);
+
+    // 结尾的'/'不影响结果
+    QCOMPARE(crawl(root.path() + '/'), expected);
+
+    FileCrawler::Options opts;
+    opts.skipHidden = false;
+    QSet<QString> all = expected;
+    all << path(".h.txt") << path(".hidden/h.txt");
+    QCOMPARE(crawl(root.path(), opts), all);
+}
+
+void tst_FileCrawler::fileStat()
+{
+    FileCrawler crawler(FileCrawler::Options {});
+    crawler.start(root.path());
+
+    QHash<QString, struct stat> stats;
+    FileCrawler::Entry entry;
+    while (crawler.next(entry))
+        stats.insert(entry.path, entry.st);
+
+    QCOMPARE(stats.size(), expected.size());
+    QCOMPARE(stats.value(path("a.txt")).st_size, off_t(5));
+    // 链接取目标文件的信息
+    QCOMPARE(stats.value(path("filelink")).st_ino, stats.value(path("a.txt")).st_ino);
+    QVERIFY(S_ISFIFO(stats.value(path("fifo")).st_mode));
+}
+
+void tst_FileCrawler::maxDepth()
+{
+    FileCrawler::Options opts;
+    opts.maxDepth = 0;
+    QVERIFY(crawl(root.path(), opts).isEmpty());
+
+    opts.maxDepth = 1;
+    QCOMPARE(crawl(root.path(), opts), QSet<QString>({ path("a.txt"), path("filelink"), path("fifo") }));
+
+    opts.maxDepth = 2;
+    QCOMPARE(crawl(root.path(), opts),
+             QSet<QString>({ path("a.txt"), path("filelink"), path("fifo"), path("d1/b.txt"),
+                             path("black/x.txt"), path("link_out/o.txt") }));
+}
+
+void tst_FileCrawler::blacklist()
+{
+    FileCrawler::Options opts;
+    opts.blacklist << path("black") << path("d1/d2");
+
+    QSet<QString> files = expected;
+    files.remove(path("black/x.txt"));
+    files.remove(path("d1/d2/c.txt"));
+    QCOMPARE(crawl(root.path(), opts), files);
+
+    // 起点本身命中时不遍历
+    QVERIFY(crawl(path("black"), opts).isEmpty());
+}
+
+void tst_FileCrawler::startOnFile()
+{
+    QCOMPARE(crawl(path("a.txt")), QSet<QString>({ path("a.txt") }));
+    QCOMPARE(crawl(path("fifo")), QSet<QString>({ path("fifo") }));
+    QVERIFY(crawl(path("dangling")).isEmpty());
+    QVERIFY(crawl(path("none")).isEmpty());
+}
+
+void tst_FileCrawler::cancel()
+{
+    FileCrawler::Options opts;
+    opts.queueSize = 1;
+    FileCrawler crawler(opts);
+    crawler.start(root.path());
+
+    FileCrawler::Entry entry;
+    QVERIFY(crawler.next(entry));
+    crawler.cancel();
+    QVERIFY(!crawler.next(entry));
+}
+
+void tst_FileCrawler::concurrentCrawls()
+{
+    // 同时进行的遍历多于共享线程池的线程数，排队的工作线程也能完成
+    const int count = QThread::idealThreadCount() * 2 + 1;
+    std::atomic<int> matched { 0 };
+    std::vector<std::thread> consumers;
+    for (int i = 0; i < count; ++i) {
+        consumers.emplace_back([this, &matched]() {
+            FileCrawler::Options opts;
+            opts.queueSize = 1;
+            if (crawl(root.path(), opts) == expected)
+                ++matched;
+        });
+    }
+
+    for (std::thread &consumer : consumers)
+        consumer.join();
+    QCOMPARE(matched.load(), count);
+}
+
+void tst_FileCrawler::destroyUnconsumed()
+{
+    // 队列满时未取走结果即析构，不应阻塞
+    for (int i = 0; i < 4; ++i) {
+        FileCrawler::Options opts;
+        opts.queueSize = 1;
+        FileCrawler crawler(opts);
+        crawler.start(root.path());
+    }
+}
+
+QTEST_GUILESS_MAIN(tst_FileCrawler)
+
+#include "tst_filecrawler.moc"
@@ -0,0 +1,223 @@
+// SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "index/vectorindex/textchunker.h"
+#include "index/global_define.h"
+
+#include <QtTest>
+#include <QRegularExpression>
+
+#include <random>
+
+// 单遍分块替换前的正则实现，作为对照
+static QStringList regexSplit(QString texts)
+{
+    QStringList chunks;
+
+    QRegularExpression regexSplit("[\n，；。,.]");
+    QRegularExpression regexInvalidChar("[\\s\u200B]+");
+    texts.replace(regexInvalidChar, " ");
+
+    const QStringList splitTexts = texts.split(regexSplit, QString::SkipEmptyParts);
+
+    QString over = "";
+    for (QString text : splitTexts) {
+        text = over + text;
+        over = "";
+
+        if (text.length() > kMaxChunksSize) {
+            for (int pos = 0; pos < text.length(); pos += kMaxChunksSize) {
+                const QString part = text.mid(pos, kMaxChunksSize);
+                if (part.length() < kMaxChunksSize) {
+                    over += part;
+                    break;
+                }
+                chunks << part;
+            }
+        } else if (text.length() > kMinChunksSize && text.length() < kMaxChunksSize) {
+            chunks << text;
+        } else {
+            over = text;
+        }
+    }
+
+    if (over.length() > kMinChunksSize)
+        chunks << over;
+    else {
+        if (chunks.isEmpty())
+            chunks << over;
+        else
+            chunks.last() += over;
+    }
+
+    return chunks;
+}
+
+// 源文本区间按旧实现的规则折叠空白、去掉分隔符后应与块文本一致
+static QString normalize(QString text)
+{
+    text.replace(QRegularExpression("[\\s\u200B]+"), " ");
+    text.remove(QRegularExpression("[\n，；。,.]"));
+    return text;
+}
+
+static QStringList chunkTexts(const QList<TextChunk> &chunks)
+{
+    QStringList texts;
+    for (const TextChunk &chunk : chunks)
+        texts << chunk.text;
+    return texts;
+}
+
+// 句子长度分布覆盖200/300的合并与切分边界
+static QString randomText(std::mt19937 &rng)
+{
+    static const QString normal = QString::fromUtf8("abcxyz中文字符😀");
+    static const QString spaces = QString::fromUtf8(" \t\n\r\u200B");
+    static const QString separators = QString::fromUtf8(",.，；。");
+    static const double sepRates[] = { 0.001, 0.003, 0.006, 0.02, 0.1 };
+
+    std::uniform_int_distribution<int> lengthDist(1, 1500);
+    std::uniform_real_distribution<double> prob(0, 1);
+    const double sepRate = sepRates[std::uniform_int_distribution<int>(0, 4)(rng)];
+
+    const int length = lengthDist(rng);
+    QString text;
+    text.reserve(length);
+    while (text.size() < length) {
+        const double p = prob(rng);
+        if (p < sepRate) {
+            text += separators.at(std::uniform_int_distribution<int>(0, separators.size() - 1)(rng));
+        } else if (p < sepRate + 0.15) {
+            text += spaces.at(std::uniform_int_distribution<int>(0, spaces.size() - 1)(rng));
+        } else {
+            // 代理对整体追加
+            int i = std::uniform_int_distribution<int>(0, normal.size() - 1)(rng);
+            if (normal.at(i).isLowSurrogate())
+                --i;
+            text += normal.at(i);
+            if (normal.at(i).isHighSurrogate())
+                text += normal.at(i + 1);
+        }
+    }
+    return text;
+}
+
+class tst_TextChunker : public QObject
+{
+    Q_OBJECT
+private slots:
+    void matchesRegexSplitter();
+    void offsetsCoverChunkText();
+    void boundaries_data();
+    void boundaries();
+    void utf16Offsets();
+    void zeroChunks();
+    void headingInMergedChunk();
+};
+
+void tst_TextChunker::matchesRegexSplitter()
+{
+    std::mt19937 rng(20240601);
+    for (int round = 0; round < 2000; ++round) {
+        const QString text = randomText(rng);
+        const QStringList expected = regexSplit(text);
+        QCOMPARE(chunkTexts(TextChunker::split(text)), expected);
+
+        // 限制块数时与旧实现取前若干块的结果一致
+        for (int cap : { 1, 3, 10 })
+            QCOMPARE(chunkTexts(TextChunker::split(text, cap)), expected.mid(0, cap));
+    }
+}
+
+void tst_TextChunker::offsetsCoverChunkText()
+{
+    std::mt19937 rng(7);
+    for (int round = 0; round < 500; ++round) {
+        const QString text = randomText(rng);
+        int prevEnd = 0;
+        for (const TextChunk &chunk : TextChunker::split(text)) {
+            QVERIFY(chunk.start >= prevEnd);
+            QVERIFY(chunk.start + chunk.length <= text.size());
+            QCOMPARE(normalize(text.mid(chunk.start, chunk.length)), chunk.text);
+            prevEnd = chunk.start + chunk.length;
+        }
+    }
+}
+
+void tst_TextChunker::boundaries_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<QList<int>>("starts");
+    QTest::addColumn<QList<int>>("lengths");
+    QTest::addColumn<QList<int>>("sizes");
+
+    const QString a(650, QLatin1Char('a'));
+    const QString b(250, QLatin1Char('b'));
+
+    QTest::newRow("short only") << a.left(150) << QList<int> { 0 } << QList<int> { 150 } << QList<int> { 150 };
+    QTest::newRow("short merged forward") << a.left(150) + "." + b.left(100)
+                                          << QList<int> { 0 } << QList<int> { 251 } << QList<int> { 250 };
+    QTest::newRow("200 merged forward") << a.left(200) + "." + b.left(10)
+                                        << QList<int> { 0 } << QList<int> { 211 } << QList<int> { 210 };
+    QTest::newRow("201 kept") << a.left(201) + "." + b
+                              << QList<int> { 0, 202 } << QList<int> { 201, 250 } << QList<int> { 201, 250 };
+    QTest::newRow("tail merged back") << a.left(250) + "." + b.left(100)
+                                      << QList<int> { 0 } << QList<int> { 351 } << QList<int> { 350 };
+    QTest::newRow("300 not split") << a.left(300) << QList<int> { 0 } << QList<int> { 300 } << QList<int> { 300 };
+    QTest::newRow("301 split") << a.left(301) + "." + b
+                               << QList<int> { 0, 300 } << QList<int> { 300, 252 } << QList<int> { 300, 251 };
+    QTest::newRow("long split") << a << QList<int> { 0, 300 } << QList<int> { 300, 350 } << QList<int> { 300, 350 };
+}
+
+void tst_TextChunker::boundaries()
+{
+    QFETCH(QString, text);
+    QFETCH(QList<int>, starts);
+    QFETCH(QList<int>, lengths);
+    QFETCH(QList<int>, sizes);
+
+    const QList<TextChunk> chunks = TextChunker::split(text);
+    QCOMPARE(chunkTexts(chunks), regexSplit(text));
+    QCOMPARE(chunks.size(), starts.size());
+    for (int i = 0; i < chunks.size(); ++i) {
+        QCOMPARE(chunks.at(i).start, starts.at(i));
+        QCOMPARE(chunks.at(i).length, lengths.at(i));
+        QCOMPARE(chunks.at(i).text.size(), sizes.at(i));
+    }
+}
+
+void tst_TextChunker::utf16Offsets()
+{
+    // 偏移按UTF-16计，代理对占两个位置
+    const QString text = QString::fromUtf8("，，😀abc。中文");
+    const QList<TextChunk> chunks = TextChunker::split(text);
+    QCOMPARE(chunks.size(), 1);
+    QCOMPARE(chunks.first().text, QString::fromUtf8("😀abc中文"));
+    QCOMPARE(chunks.first().start, 2);
+    QCOMPARE(chunks.first().length, 8);
+}
+
+void tst_TextChunker::zeroChunks()
+{
+    QVERIFY(TextChunker::split(QStringLiteral("abc"), 0).isEmpty());
+}
+
+void tst_TextChunker::headingInMergedChunk()
+{
+    // 短句与标题、正文合并为第4块，标题不在块的开头
+    const QString text = QString(250, QLatin1Char('a')) + ".\n" + QString(250, QLatin1Char('b')) + ".\n"
+            + QString(250, QLatin1Char('c')) + ".\n" + QString(100, QLatin1Char('d')) + ".\nHeading\n"
+            + QString(150, QLatin1Char('e')) + ".\n" + QString(250, QLatin1Char('f'));
+    const QList<TextChunk> chunks = TextChunker::split(text);
+    QCOMPARE(chunks.size(), 5);
+    QVERIFY(chunks.at(3).text.contains(QStringLiteral("Heading")));
+
+    QCOMPARE(TextChunker::sample(text, chunks, 2, TextChunker::Headings), (QVector<int> { 0, 3 }));
+    QCOMPARE(TextChunker::sample(text, chunks, 2, TextChunker::Stride), (QVector<int> { 0, 2 }));
+}
+
+QTEST_GUILESS_MAIN(tst_TextChunker)
+
+#include "tst_textchunker.moc"
@@ -0,0 +1,136 @@
+// SPDX-FileCopyrightText: 2024 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "index/vectorindex/vectorstore.h"
+
+#include <QtTest>
+
+#include <cstring>
+#include <vector>
+
+// 奇数维度，行尾不与对齐边界重合
+static constexpr int kDim = 7;
+
+static std::vector<float> vectorOf(faiss::idx_t id)
+{
+    std::vector<float> vec(kDim);
+    for (int k = 0; k < kDim; ++k)
+        vec[static_cast<size_t>(k)] = static_cast<float>(id * 10 + k);
+    return vec;
+}
+
+// 各行的id与向量内容一一对应
+static bool rowsMatch(const VectorStore &store, const QList<faiss::idx_t> &expected)
+{
+    if (store.size() != expected.size())
+        return false;
+
+    for (faiss::idx_t row = 0; row < store.size(); ++row) {
+        const faiss::idx_t id = expected.at(static_cast<int>(row));
+        if (*store.ids(row) != id)
+            return false;
+        const std::vector<float> vec = vectorOf(id);
+        if (memcmp(store.vectors(row), vec.data(), sizeof(float) * kDim) != 0)
+            return false;
+    }
+    return true;
+}
+
+class tst_VectorStore : public QObject
+{
+    Q_OBJECT
+private slots:
+    void appendGrows();
+    void upperBound();
+    void removeCompacts();
+    void removeNothing();
+    void clearKeepsBuffer();
+};
+
+void tst_VectorStore::appendGrows()
+{
+    // 超过初始容量，经过多次扩容
+    VectorStore store(kDim);
+    QList<faiss::idx_t> ids;
+    for (faiss::idx_t id = 1; id <= 300; ++id) {
+        store.append(id, vectorOf(id).data());
+        ids << id;
+    }
+
+    QCOMPARE(store.dimension(), kDim);
+    QVERIFY(rowsMatch(store, ids));
+    QCOMPARE(reinterpret_cast<quintptr>(store.vectors()) % 64, quintptr(0));
+    // 行与行连续存放
+    QCOMPARE(store.vectors(5), store.vectors() + 5 * kDim);
+}
+
+void tst_VectorStore::upperBound()
+{
+    VectorStore store(kDim);
+    for (faiss::idx_t id : { 10, 20, 30 })
+        store.append(id, vectorOf(id).data());
+
+    QCOMPARE(store.upperBound(5), faiss::idx_t(0));
+    QCOMPARE(store.upperBound(10), faiss::idx_t(1));
+    QCOMPARE(store.upperBound(25), faiss::idx_t(2));
+    QCOMPARE(store.upperBound(30), faiss::idx_t(3));
+}
+
+void tst_VectorStore::removeCompacts()
+{
+    VectorStore store(kDim);
+    QList<faiss::idx_t> ids;
+    for (faiss::idx_t id = 1; id <= 200; ++id) {
+        store.append(id, vectorOf(id).data());
+        ids << id;
+    }
+
+    // 首行、末行、连续的一段与不存在的id
+    QSet<faiss::idx_t> removeIds { 1, 200, 1000 };
+    for (faiss::idx_t id = 50; id < 80; ++id)
+        removeIds << id;
+
+    QCOMPARE(store.remove(removeIds), 32);
+    for (faiss::idx_t id : removeIds)
+        ids.removeOne(id);
+    QVERIFY(rowsMatch(store, ids));
+
+    // 压实后仍可继续追加
+    store.append(201, vectorOf(201).data());
+    ids << 201;
+    QVERIFY(rowsMatch(store, ids));
+
+    QSet<faiss::idx_t> all;
+    for (faiss::idx_t id : ids)
+        all << id;
+    QCOMPARE(store.remove(all), ids.size());
+    QVERIFY(store.isEmpty());
+}
+
+void tst_VectorStore::removeNothing()
+{
+    VectorStore store(kDim);
+    store.append(1, vectorOf(1).data());
+    QCOMPARE(store.remove({}), 0);
+    QCOMPARE(store.remove({ 2 }), 0);
+    QVERIFY(rowsMatch(store, { 1 }));
+}
+
+void tst_VectorStore::clearKeepsBuffer()
+{
+    VectorStore store(kDim);
+    store.append(1, vectorOf(1).data());
+    const float *buffer = store.vectors();
+
+    store.clear();
+    QVERIFY(store.isEmpty());
+
+    store.append(2, vectorOf(2).data());
+    QCOMPARE(store.vectors(), buffer);
+    QVERIFY(rowsMatch(store, { 2 }));
+}
+
+QTEST_GUILESS_MAIN(tst_VectorStore)
+
+#include "tst_vectorstore.moc"